@@ -11,38 +11,141 @@
 #include <errno.h>
 #include <sys/mman.h>
 #include <sys/types.h>
-#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <sys/utsname.h>
+#include <sys/sendfile.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <time.h>
 #include <unistd.h>
 #include <sched.h>
+#include <stdint.h>
+#include <limits.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <linux/perf_event.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define HAVE_X86 1
+#endif
+
+/* most workers we can have */
 #define PROCMAP_SIZE 4096
 
 /* how many runs to average by default */
 #define DEFAULT_NR_LOOPS 10
 
-/* we have 3 tests at the moment */
-#define MAX_TESTS 3
-
-/* default block size for test 2, in bytes */
+/* default block size for mcblock, in bytes */
 #define DEFAULT_BLOCK_SIZE 262144
 
-/* test types */
-#define TEST_MEMCPY 0
-#define TEST_DUMB 1
-#define TEST_MCBLOCK 2
+/* at most this many working set sizes in a sweep */
+#define MAX_SIZES 64
+
+/* smallest working set of the latency test, in bytes */
+#define LATENCY_MIN_SIZE 4096
+
+/* loads per repeat are at least this many, or one walk of the chain */
+#define LATENCY_MIN_LOADS 262144
+
+/* chain granularity: one pointer per cache line or per page */
+#define LATENCY_LINE 64
+#define LATENCY_PAGE 4096
+
+/* how long the hogs run before the probes start, in microseconds */
+#define LOADED_WARMUP_US 100000
+
+/* default injected delays after each hog chunk, in ns, from light to
+ * full load; the idle level (no hog traffic) is always measured first */
+#define LOADED_DEFAULT_DELAYS "50000,20000,10000,5000,2000,1000,500,200,100,0"
+
+/* --histogram: number of bins and width of the longest bar */
+#define HISTOGRAM_BINS 10
+#define HISTOGRAM_WIDTH 50
+
+/* how long to calibrate the TSC for --tsc, in milliseconds */
+#define TSC_CALIBRATE_MS 200
+
+/* highest NUMA node number + 1 we can bind to */
+#define MAX_NUMA_NODES 1024
+
+/* --cold: how the arrays are evicted before each pass */
+#define COLD_CLFLUSH 1
+#define COLD_EVICT 2
+/* eviction buffer if the cache sizes are unknown */
+#define COLD_EVICT_FALLBACK (256ULL << 20)
+
+/* --shared: a thread count saturates the memory once it gets this
+ * fraction of the best bandwidth */
+#define SHARED_SATURATION 0.95
+
+/* --small: default sizes, calls per sample at least, and the shortest sample */
+#define SMALL_DEFAULT_SIZES "1:64K:x2"
+#define SMALL_MIN_CALLS 16
+#define SMALL_SAMPLE_SECONDS 1e-3
+
+/* --src-offset/--dst-offset are from a boundary of this many bytes */
+#define OFFSET_ALIGN 4096
+/* at most this many offsets in an offset sweep, and the default ones */
+#define MAX_OFFSETS 32
+#define OFFSET_DEFAULT_SWEEP "0,1,8,16,32,64,2048,4032"
+
+/* default --stride of the stride test and of --index stride, in bytes */
+#define DEFAULT_ACCESS_STRIDE 64
+
+/* --prefetch: default distance in bytes; --prefetch-sweep: default distances */
+#define DEFAULT_PREFETCH_DISTANCE 512
+#define PREFETCH_DEFAULT_SWEEP "64:16K:x2"
+
+/* --ipc: default message sizes, bytes moved per sample (at least
+ * IPC_MIN_CALLS messages), pipe buffer we ask for */
+#define IPC_DEFAULT_SIZES "4K:64M:x4"
+#define IPC_TARGET_BYTES (64ULL << 20)
+#define IPC_MIN_CALLS 8
+#define IPC_PIPE_SIZE (1 << 20)
+
+/* --c2c: bytes the bounced line has to itself, untimed round trips,
+ * timed round trips per sample */
+#define C2C_LINE 128
+#define C2C_WARMUP 1000
+#define C2C_ROUND_TRIPS 10000
+
+/* --spsc: default message and ring sizes, bytes per sample (at least
+ * SPSC_MIN_MESSAGES messages) */
+#define SPSC_DEFAULT_MSGS "64:64K:x8"
+#define SPSC_DEFAULT_RINGS "64K:16M:x16"
+#define SPSC_TARGET_BYTES (64ULL << 20)
+#define SPSC_MIN_MESSAGES 1024
+
+/* --baseline: default regression threshold in percent, and the exit
+ * status of a run that regressed */
+#define BASELINE_DEFAULT_THRESHOLD 5.0
+#define EXIT_REGRESSED 2
+
+/* --auto: default sample duration in ms; --ci: fewest samples to judge
+ * a confidence interval by, and the most samples unless -n says */
+#define AUTO_DEFAULT_MS 50
+#define CI_MIN_SAMPLES 5
+#define CI_MAX_LOOPS 1000
+
+/* -n 0: samples kept per worker for the controller, default seconds
+ * between reports, intervals averaged as the reference for drift */
+#define SOAK_RING 4096
+#define SOAK_DEFAULT_INTERVAL 1.0
+#define SOAK_BASELINE 5
+
+/* multiplier for the STREAM-style scale and triad tests */
+#define STREAM_SCALAR 3
 
 /* version number */
-#define VERSION "1.4"
-
-#define MYMEMSET(a, x, sz)                          \
-    do                                              \
-    {                                               \
-        for (int __memi = 0; __memi < sz; __memi++) \
-        {                                           \
-            ((char *)a)[__memi] = x;                \
-        }                                           \
-    } while (0)
+#define VERSION "1.5"
 
 /*
  * MBW memory bandwidth benchmark
@@ -65,184 +168,5171 @@
  * watch out for swap usage (or turn off swap)
  */
 
+/* ------------------------------------------------------ */
+
+/* CPU features, filled in by detect_cpu_features() at startup so that
+ * a single static binary picks the right kernels on every host */
+int cpu_has_sse2 = 0;
+int cpu_has_erms = 0;
+int cpu_has_avx2 = 0;
+int cpu_has_avx512f = 0;
+
+#ifdef HAVE_X86
+/* cpuid leaf 7 bits, not every cpuid.h knows them */
+#define MBW_BIT_AVX2 (1 << 5)
+#define MBW_BIT_ERMS (1 << 9)
+#define MBW_BIT_AVX512F (1 << 16)
+
+/* XCR0: which register states the OS saves on context switch */
+static unsigned long long xgetbv0(void)
+{
+    unsigned int lo, hi;
+    __asm__ volatile("xgetbv"
+                     : "=a"(lo), "=d"(hi)
+                     : "c"(0));
+    return ((unsigned long long)hi << 32) | lo;
+}
+#endif
+
+void detect_cpu_features()
+{
+#ifdef HAVE_X86
+    unsigned int eax, ebx, ecx, edx;
+    unsigned long long xcr0 = 0;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return;
+    cpu_has_sse2 = !!(edx & bit_SSE2);
+    /* the CPU supporting AVX is not enough, the OS must save ymm/zmm too */
+    if (ecx & bit_OSXSAVE)
+        xcr0 = xgetbv0();
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        return;
+    cpu_has_erms = !!(ebx & MBW_BIT_ERMS);
+    /* xmm|ymm */
+    cpu_has_avx2 = (ebx & MBW_BIT_AVX2) && (xcr0 & 0x6) == 0x6;
+    /* xmm|ymm|opmask|zmm_hi256|hi16_zmm */
+    cpu_has_avx512f = (ebx & MBW_BIT_AVX512F) && (xcr0 & 0xe6) == 0xe6;
+#endif
+}
+
+/* ------------------------------------------------------ */
+
+/* explicit copy kernels: dst and src may have any alignment,
+ * n is in bytes */
+typedef void (*copy_fn)(void *dst, const void *src, size_t n);
+
+#ifdef HAVE_X86
+void copy_movsb(void *dst, const void *src, size_t n)
+{
+    __asm__ volatile("rep movsb"
+                     : "+D"(dst), "+S"(src), "+c"(n)
+                     :
+                     : "memory");
+}
+
+__attribute__((target("sse2"))) void copy_sse2(void *dst, const void *src, size_t n)
+{
+    char *d = dst;
+    const char *s = src;
+    for (; n >= 64; n -= 64, d += 64, s += 64)
+    {
+        __m128i x0 = _mm_loadu_si128((const __m128i *)s);
+        __m128i x1 = _mm_loadu_si128((const __m128i *)(s + 16));
+        __m128i x2 = _mm_loadu_si128((const __m128i *)(s + 32));
+        __m128i x3 = _mm_loadu_si128((const __m128i *)(s + 48));
+        _mm_storeu_si128((__m128i *)d, x0);
+        _mm_storeu_si128((__m128i *)(d + 16), x1);
+        _mm_storeu_si128((__m128i *)(d + 32), x2);
+        _mm_storeu_si128((__m128i *)(d + 48), x3);
+    }
+    memcpy(d, s, n);
+}
+
+/* streaming stores need an aligned destination: copy the head with
+ * memcpy first, then bypass the cache for the bulk */
+__attribute__((target("sse2"))) void copy_sse2_nt(void *dst, const void *src, size_t n)
+{
+    char *d = dst;
+    const char *s = src;
+    size_t head = -(uintptr_t)d & 15;
+    if (head > n)
+        head = n;
+    memcpy(d, s, head);
+    d += head, s += head, n -= head;
+    for (; n >= 64; n -= 64, d += 64, s += 64)
+    {
+        __m128i x0 = _mm_loadu_si128((const __m128i *)s);
+        __m128i x1 = _mm_loadu_si128((const __m128i *)(s + 16));
+        __m128i x2 = _mm_loadu_si128((const __m128i *)(s + 32));
+        __m128i x3 = _mm_loadu_si128((const __m128i *)(s + 48));
+        _mm_stream_si128((__m128i *)d, x0);
+        _mm_stream_si128((__m128i *)(d + 16), x1);
+        _mm_stream_si128((__m128i *)(d + 32), x2);
+        _mm_stream_si128((__m128i *)(d + 48), x3);
+    }
+    _mm_sfence();
+    memcpy(d, s, n);
+}
+
+__attribute__((target("avx2"))) void copy_avx2(void *dst, const void *src, size_t n)
+{
+    char *d = dst;
+    const char *s = src;
+    for (; n >= 128; n -= 128, d += 128, s += 128)
+    {
+        __m256i y0 = _mm256_loadu_si256((const __m256i *)s);
+        __m256i y1 = _mm256_loadu_si256((const __m256i *)(s + 32));
+        __m256i y2 = _mm256_loadu_si256((const __m256i *)(s + 64));
+        __m256i y3 = _mm256_loadu_si256((const __m256i *)(s + 96));
+        _mm256_storeu_si256((__m256i *)d, y0);
+        _mm256_storeu_si256((__m256i *)(d + 32), y1);
+        _mm256_storeu_si256((__m256i *)(d + 64), y2);
+        _mm256_storeu_si256((__m256i *)(d + 96), y3);
+    }
+    _mm256_zeroupper();
+    memcpy(d, s, n);
+}
+
+__attribute__((target("avx2"))) void copy_avx2_nt(void *dst, const void *src, size_t n)
+{
+    char *d = dst;
+    const char *s = src;
+    size_t head = -(uintptr_t)d & 31;
+    if (head > n)
+        head = n;
+    memcpy(d, s, head);
+    d += head, s += head, n -= head;
+    for (; n >= 128; n -= 128, d += 128, s += 128)
+    {
+        __m256i y0 = _mm256_loadu_si256((const __m256i *)s);
+        __m256i y1 = _mm256_loadu_si256((const __m256i *)(s + 32));
+        __m256i y2 = _mm256_loadu_si256((const __m256i *)(s + 64));
+        __m256i y3 = _mm256_loadu_si256((const __m256i *)(s + 96));
+        _mm256_stream_si256((__m256i *)d, y0);
+        _mm256_stream_si256((__m256i *)(d + 32), y1);
+        _mm256_stream_si256((__m256i *)(d + 64), y2);
+        _mm256_stream_si256((__m256i *)(d + 96), y3);
+    }
+    _mm_sfence();
+    _mm256_zeroupper();
+    memcpy(d, s, n);
+}
+
+__attribute__((target("avx512f"))) void copy_avx512(void *dst, const void *src, size_t n)
+{
+    char *d = dst;
+    const char *s = src;
+    for (; n >= 256; n -= 256, d += 256, s += 256)
+    {
+        __m512i z0 = _mm512_loadu_si512((const void *)s);
+        __m512i z1 = _mm512_loadu_si512((const void *)(s + 64));
+        __m512i z2 = _mm512_loadu_si512((const void *)(s + 128));
+        __m512i z3 = _mm512_loadu_si512((const void *)(s + 192));
+        _mm512_storeu_si512((void *)d, z0);
+        _mm512_storeu_si512((void *)(d + 64), z1);
+        _mm512_storeu_si512((void *)(d + 128), z2);
+        _mm512_storeu_si512((void *)(d + 192), z3);
+    }
+    _mm256_zeroupper();
+    memcpy(d, s, n);
+}
+
+__attribute__((target("avx512f"))) void copy_avx512_nt(void *dst, const void *src, size_t n)
+{
+    char *d = dst;
+    const char *s = src;
+    size_t head = -(uintptr_t)d & 63;
+    if (head > n)
+        head = n;
+    memcpy(d, s, head);
+    d += head, s += head, n -= head;
+    for (; n >= 256; n -= 256, d += 256, s += 256)
+    {
+        __m512i z0 = _mm512_loadu_si512((const void *)s);
+        __m512i z1 = _mm512_loadu_si512((const void *)(s + 64));
+        __m512i z2 = _mm512_loadu_si512((const void *)(s + 128));
+        __m512i z3 = _mm512_loadu_si512((const void *)(s + 192));
+        _mm512_stream_si512((void *)d, z0);
+        _mm512_stream_si512((void *)(d + 64), z1);
+        _mm512_stream_si512((void *)(d + 128), z2);
+        _mm512_stream_si512((void *)(d + 192), z3);
+    }
+    _mm_sfence();
+    _mm256_zeroupper();
+    memcpy(d, s, n);
+}
+#endif
+
+/* ------------------------------------------------------ */
+
+/* everything a kernel needs for one pass over the test arrays */
+struct kernel_args
+{
+    long *a, *b, *c;               /* test arrays, c only if nr_arrays > 2 */
+    unsigned long long asize;       /* number of longs in each array */
+    unsigned long long array_bytes; /* size of each array in bytes */
+    unsigned long long block_size;  /* for mcblock */
+    int rep;                        /* index of the current repeat */
+    const unsigned int *idx;        /* index array of gather and scatter */
+    int cold;                       /* COLD_*: evict the arrays before every pass */
+    char *evict;                    /* eviction buffer for COLD_EVICT */
+    unsigned long long evict_bytes;
+};
+
+/* the read-only test stores its sum here so it can't be optimized away */
+volatile long read_sink;
+
+void run_memcpy(const struct kernel_args *ka)
+{
+    memcpy(ka->b, ka->a, ka->array_bytes);
+}
+
+void run_dumb(const struct kernel_args *ka)
+{
+    volatile long *va = ka->a, *vb = ka->b;
+    for (unsigned long long t = 0; t < ka->asize; t++)
+    {
+        vb[t] = va[t];
+    }
+}
+
+void run_mcblock(const struct kernel_args *ka)
+{
+    unsigned long long t;
+    unsigned long long block_size = ka->block_size;
+    char *aa = (char *)ka->a;
+    char *bb = (char *)ka->b;
+    for (t = ka->array_bytes; t >= block_size; t -= block_size, aa += block_size)
+    {
+        bb = mempcpy(bb, aa, block_size);
+    }
+    if (t)
+    {
+        bb = mempcpy(bb, aa, t);
+    }
+}
+
+void run_read(const struct kernel_args *ka)
+{
+    const long *a = ka->a;
+    long sum = 0;
+    for (unsigned long long t = 0; t < ka->asize; t++)
+    {
+        sum += a[t];
+    }
+    read_sink = sum;
+}
+
+void run_write(const struct kernel_args *ka)
+{
+    long *b = ka->b;
+    for (unsigned long long t = 0; t < ka->asize; t++)
+    {
+        b[t] = ka->rep;
+    }
+}
+
+void run_scale(const struct kernel_args *ka)
+{
+    const long *a = ka->a;
+    long *b = ka->b;
+    for (unsigned long long t = 0; t < ka->asize; t++)
+    {
+        b[t] = STREAM_SCALAR * a[t];
+    }
+}
+
+void run_add(const struct kernel_args *ka)
+{
+    const long *a = ka->a, *b = ka->b;
+    long *c = ka->c;
+    for (unsigned long long t = 0; t < ka->asize; t++)
+    {
+        c[t] = a[t] + b[t];
+    }
+}
+
+void run_triad(const struct kernel_args *ka)
+{
+    const long *b = ka->b, *c = ka->c;
+    long *a = ka->a;
+    for (unsigned long long t = 0; t < ka->asize; t++)
+    {
+        a[t] = b[t] + STREAM_SCALAR * c[t];
+    }
+}
+
+/* the access pattern tests, configured by --stride and --index */
+
+/* order of the index array of gather and scatter */
+enum
+{
+    INDEX_SEQ,    /* 0, 1, 2, ... */
+    INDEX_STRIDE, /* every access_stride bytes, then the next column */
+    INDEX_RANDOM, /* a random permutation */
+};
+
+const char *index_names[] = {"seq", "stride", "random"};
+
+unsigned int access_stride = DEFAULT_ACCESS_STRIDE; /* bytes, a multiple of a long */
+int index_pattern = INDEX_RANDOM;
+
+/* one long every access_stride bytes */
+void run_stride(const struct kernel_args *ka)
+{
+    const long *a = ka->a;
+    unsigned long long step = access_stride / sizeof(long);
+    long sum = 0;
+    for (unsigned long long t = 0; t < ka->asize; t += step)
+    {
+        sum += a[t];
+    }
+    read_sink = sum;
+}
+
+void run_gather(const struct kernel_args *ka)
+{
+    const long *a = ka->a;
+    const unsigned int *idx = ka->idx;
+    long *b = ka->b;
+    for (unsigned long long t = 0; t < ka->asize; t++)
+    {
+        b[t] = a[idx[t]];
+    }
+}
+
+void run_scatter(const struct kernel_args *ka)
+{
+    const long *a = ka->a;
+    const unsigned int *idx = ka->idx;
+    long *b = ka->b;
+    for (unsigned long long t = 0; t < ka->asize; t++)
+    {
+        b[idx[t]] = a[t];
+    }
+}
+
+/* whole 64 byte lines at random, as many as the array has; the loads
+ * don't depend on each other, unlike --latency */
+void run_randline(const struct kernel_args *ka)
+{
+    /* start on a line boundary so every access is one line */
+    const char *base = (const char *)(((uintptr_t)ka->a + 63) & ~(uintptr_t)63);
+    unsigned long long nr_lines = (ka->array_bytes - (base - (const char *)ka->a)) / 64;
+    unsigned long long x = 0x9e3779b97f4a7c15ULL + ka->rep;
+    long sum = 0;
+    for (unsigned long long t = 0; t < nr_lines; t++)
+    {
+        /* xorshift64, scaled to the number of lines without a division */
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        const long *line = (const long *)(base + (unsigned long long)(((unsigned __int128)x * nr_lines) >> 64) * 64);
+        sum += line[0] + line[1] + line[2] + line[3] + line[4] + line[5] + line[6] + line[7];
+    }
+    read_sink = sum;
+}
+
+/* cache lines moved per long accessed through the index array, in
+ * arrays: sequential shares lines, random and wide strides don't */
+double index_lines(void)
+{
+    if (index_pattern == INDEX_SEQ)
+        return 1;
+    if (index_pattern == INDEX_STRIDE && access_stride < 64)
+        return access_stride / sizeof(long);
+    return 64 / sizeof(long);
+}
+
+/* traffic of the pattern tests: 'app' is the useful data, 'bus' the
+ * cache lines it takes, assuming the array doesn't fit in the cache */
+void traffic_stride(double *app, double *bus)
+{
+    *app = (double)sizeof(long) / access_stride;
+    *bus = (access_stride < 64 ? access_stride : 64.0) / access_stride;
+}
+
+/* the index array is half an array of unsigned ints */
+void traffic_gather(double *app, double *bus)
+{
+    *app = 2;
+    *bus = index_lines() + 0.5 + 2;
+}
+
+void traffic_scatter(double *app, double *bus)
+{
+    *app = 2;
+    *bus = 1 + 0.5 + 2 * index_lines();
+}
+
+void traffic_randline(double *app, double *bus)
+{
+    *app = 1;
+    *bus = 1;
+}
+
+/* software prefetch tests, configured by --prefetch */
+
+/* locality hints of __builtin_prefetch, from none to all cache levels */
+const char *prefetch_hints[] = {"nta", "t2", "t1", "t0"};
+
+long prefetch_distance = DEFAULT_PREFETCH_DISTANCE; /* bytes ahead, -1 not to prefetch */
+int prefetch_hint = 3;
+
+/* __builtin_prefetch() wants its hint as a constant: expand LOOP(pf, hint)
+ * once per hint, and once without prefetches for the baseline */
+#define PREFETCH_DISPATCH(LOOP)        \
+    do                                 \
+    {                                  \
+        if (prefetch_distance < 0)     \
+        {                              \
+            LOOP(0, 0)                 \
+        }                              \
+        else if (prefetch_hint == 0)   \
+        {                              \
+            LOOP(1, 0)                 \
+        }                              \
+        else if (prefetch_hint == 1)   \
+        {                              \
+            LOOP(1, 1)                 \
+        }                              \
+        else if (prefetch_hint == 2)   \
+        {                              \
+            LOOP(1, 2)                 \
+        }                              \
+        else                           \
+        {                              \
+            LOOP(1, 3)                 \
+        }                              \
+    } while (0)
+
+/* one prefetch per cache line of the array */
+void run_pf_read(const struct kernel_args *ka)
+{
+    const long *a = ka->a;
+    const char *pa = (const char *)a + prefetch_distance;
+    unsigned long long t, n = ka->asize;
+    long sum = 0;
+#define PF_READ_LOOP(pf, hint)                                \
+    for (t = 0; t + 8 <= n; t += 8)                           \
+    {                                                         \
+        if (pf)                                               \
+            __builtin_prefetch(pa + t * sizeof(long), 0, hint); \
+        for (int j = 0; j < 8; j++)                           \
+            sum += a[t + j];                                  \
+    }
+    PREFETCH_DISPATCH(PF_READ_LOOP);
+#undef PF_READ_LOOP
+    for (; t < n; t++)
+        sum += a[t];
+    read_sink = sum;
+}
+
+/* the source is prefetched for reading, the destination for writing
+ * (prefetchw where the CPU has it) */
+#ifdef HAVE_X86
+__attribute__((target("prfchw")))
+#endif
+void run_pf_copy(const struct kernel_args *ka)
+{
+    const long *a = ka->a;
+    long *b = ka->b;
+    const char *pa = (const char *)a + prefetch_distance;
+    char *pb = (char *)b + prefetch_distance;
+    unsigned long long t, n = ka->asize;
+#define PF_COPY_LOOP(pf, hint)                                  \
+    for (t = 0; t + 8 <= n; t += 8)                             \
+    {                                                           \
+        if (pf)                                                 \
+        {                                                       \
+            __builtin_prefetch(pa + t * sizeof(long), 0, hint); \
+            __builtin_prefetch(pb + t * sizeof(long), 1, hint); \
+        }                                                       \
+        for (int j = 0; j < 8; j++)                             \
+            b[t + j] = a[t + j];                                \
+    }
+    PREFETCH_DISPATCH(PF_COPY_LOOP);
+#undef PF_COPY_LOOP
+    for (; t < n; t++)
+        b[t] = a[t];
+}
+
+/* as the stride test, prefetching the long 'distance' bytes ahead */
+void run_pf_stride(const struct kernel_args *ka)
+{
+    const long *a = ka->a;
+    const char *pa = (const char *)a + prefetch_distance;
+    unsigned long long t, step = access_stride / sizeof(long);
+    long sum = 0;
+#define PF_STRIDE_LOOP(pf, hint)                              \
+    for (t = 0; t < ka->asize; t += step)                     \
+    {                                                         \
+        if (pf)                                               \
+            __builtin_prefetch(pa + t * sizeof(long), 0, hint); \
+        sum += a[t];                                          \
+    }
+    PREFETCH_DISPATCH(PF_STRIDE_LOOP);
+#undef PF_STRIDE_LOOP
+    read_sink = sum;
+}
+
+#ifdef HAVE_X86
+#define X86_KERNEL(fn) fn
+#else
+#define X86_KERNEL(fn) NULL
+#endif
+
+/* a benchmark kernel.
+ * Traffic is given per pass, in units of one array: a copy reads one
+ * array and writes one.  write_allocate is the fraction of the written
+ * bytes the cache additionally reads (read-for-ownership) before
+ * overwriting them: 1 for ordinary stores, 0 for streaming stores.
+ * Exactly one of run/copy is set; copy kernels copy a to b.
+ * The access pattern tests compute their traffic with 'traffic' instead.
+ * Tests marked on_request only run when asked for. */
+struct kernel
+{
+    const char *name;
+    const char *desc;
+    void (*run)(const struct kernel_args *);
+    copy_fn copy;
+    int nr_arrays;
+    double bytes_read;
+    double bytes_written;
+    double write_allocate;
+    const int *requires; /* CPU feature flag, NULL if none needed */
+    void (*traffic)(double *app, double *bus);
+    int needs_index;     /* uses the index array */
+    int on_request;      /* not part of the default run */
+};
+
+/* the index in this table is the number accepted by -t */
+struct kernel kernels[] = {
+    {.name = "memcpy", .desc = "memcpy test",
+     .run = run_memcpy, .nr_arrays = 2, .bytes_read = 1, .bytes_written = 1, .write_allocate = 1},
+    {.name = "dumb", .desc = "dumb (b[i]=a[i] style) test",
+     .run = run_dumb, .nr_arrays = 2, .bytes_read = 1, .bytes_written = 1, .write_allocate = 1},
+    {.name = "mcblock", .desc = "memcpy test with fixed block size",
+     .run = run_mcblock, .nr_arrays = 2, .bytes_read = 1, .bytes_written = 1, .write_allocate = 1},
+    {.name = "movsb", .desc = "rep movsb copy test",
+     .copy = X86_KERNEL(copy_movsb), .nr_arrays = 2, .bytes_read = 1, .bytes_written = 1, .write_allocate = 1},
+    {.name = "sse2", .desc = "SSE2 copy test",
+     .copy = X86_KERNEL(copy_sse2), .nr_arrays = 2, .bytes_read = 1, .bytes_written = 1, .write_allocate = 1, .requires = &cpu_has_sse2},
+    {.name = "sse2_nt", .desc = "SSE2 non-temporal (streaming store) copy test",
+     .copy = X86_KERNEL(copy_sse2_nt), .nr_arrays = 2, .bytes_read = 1, .bytes_written = 1, .write_allocate = 0, .requires = &cpu_has_sse2},
+    {.name = "avx2", .desc = "AVX2 copy test",
+     .copy = X86_KERNEL(copy_avx2), .nr_arrays = 2, .bytes_read = 1, .bytes_written = 1, .write_allocate = 1, .requires = &cpu_has_avx2},
+    {.name = "avx2_nt", .desc = "AVX2 non-temporal (streaming store) copy test",
+     .copy = X86_KERNEL(copy_avx2_nt), .nr_arrays = 2, .bytes_read = 1, .bytes_written = 1, .write_allocate = 0, .requires = &cpu_has_avx2},
+    {.name = "avx512", .desc = "AVX-512 copy test",
+     .copy = X86_KERNEL(copy_avx512), .nr_arrays = 2, .bytes_read = 1, .bytes_written = 1, .write_allocate = 1, .requires = &cpu_has_avx512f},
+    {.name = "avx512_nt", .desc = "AVX-512 non-temporal (streaming store) copy test",
+     .copy = X86_KERNEL(copy_avx512_nt), .nr_arrays = 2, .bytes_read = 1, .bytes_written = 1, .write_allocate = 0, .requires = &cpu_has_avx512f},
+    {.name = "read", .desc = "read-only test (sum of a[i])",
+     .run = run_read, .nr_arrays = 1, .bytes_read = 1, .bytes_written = 0, .write_allocate = 0},
+    {.name = "write", .desc = "write-only test (b[i]=const)",
+     .run = run_write, .nr_arrays = 2, .bytes_read = 0, .bytes_written = 1, .write_allocate = 1},
+    {.name = "scale", .desc = "STREAM scale test (b[i]=k*a[i])",
+     .run = run_scale, .nr_arrays = 2, .bytes_read = 1, .bytes_written = 1, .write_allocate = 1},
+    {.name = "add", .desc = "STREAM add test (c[i]=a[i]+b[i])",
+     .run = run_add, .nr_arrays = 3, .bytes_read = 2, .bytes_written = 1, .write_allocate = 1},
+    {.name = "triad", .desc = "STREAM triad test (a[i]=b[i]+k*c[i])",
+     .run = run_triad, .nr_arrays = 3, .bytes_read = 2, .bytes_written = 1, .write_allocate = 1},
+    {.name = "stride", .desc = "strided read test (one long every --stride bytes)",
+     .run = run_stride, .nr_arrays = 1, .traffic = traffic_stride, .on_request = 1},
+    {.name = "gather", .desc = "gather test (b[i]=a[idx[i]], --index order)",
+     .run = run_gather, .nr_arrays = 2, .traffic = traffic_gather, .needs_index = 1, .on_request = 1},
+    {.name = "scatter", .desc = "scatter test (b[idx[i]]=a[i], --index order)",
+     .run = run_scatter, .nr_arrays = 2, .traffic = traffic_scatter, .needs_index = 1, .on_request = 1},
+    {.name = "randline", .desc = "random 64 byte line read test",
+     .run = run_randline, .nr_arrays = 1, .traffic = traffic_randline, .on_request = 1},
+    {.name = "pf_read", .desc = "read test with software prefetch (--prefetch)",
+     .run = run_pf_read, .nr_arrays = 1, .bytes_read = 1, .bytes_written = 0, .write_allocate = 0, .on_request = 1},
+    {.name = "pf_copy", .desc = "copy test with software prefetch (--prefetch)",
+     .run = run_pf_copy, .nr_arrays = 2, .bytes_read = 1, .bytes_written = 1, .write_allocate = 1, .on_request = 1},
+    {.name = "pf_stride", .desc = "strided read test with software prefetch (--prefetch)",
+     .run = run_pf_stride, .nr_arrays = 1, .traffic = traffic_stride, .on_request = 1},
+};
+
+#define NR_KERNELS ((int)(sizeof(kernels) / sizeof(kernels[0])))
+
+/* can this CPU run the given kernel? */
+int kernel_supported(const struct kernel *k)
+{
+    if (!k->run && !k->copy)
+        return 0;
+    return k->requires == NULL || *k->requires;
+}
+
+/* look up a kernel by name or by its -t number, -1 if there is none */
+int find_kernel(const char *name)
+{
+    char *end;
+    unsigned long n = strtoul(name, &end, 10);
+    if (end != name && *end == '\0')
+        return n < NR_KERNELS ? (int)n : -1;
+    for (int i = 0; i < NR_KERNELS; i++)
+        if (!strcasecmp(kernels[i].name, name))
+            return i;
+    return -1;
+}
+
+/* application traffic of one pass, in arrays; the useful data of the
+ * access pattern tests */
+double kernel_app_arrays(const struct kernel *k)
+{
+    double app, bus;
+    if (k->traffic)
+    {
+        k->traffic(&app, &bus);
+        return app;
+    }
+    return k->bytes_read + k->bytes_written;
+}
+
+/* estimated bus traffic of one pass, in arrays; the cache lines moved by
+ * the access pattern tests */
+double kernel_bus_arrays(const struct kernel *k)
+{
+    double app, bus;
+    if (k->traffic)
+    {
+        k->traffic(&app, &bus);
+        return bus;
+    }
+    return k->bytes_read + k->bytes_written * (1 + k->write_allocate);
+}
+
 void usage()
 {
     printf("mbw memory benchmark v%s, https://github.com/raas/mbw\n", VERSION);
-    printf("Usage: mbw [options] array_size_in_MiB\n");
+    printf("Usage: mbw [options] array_size\n");
+    printf("Sizes are in MiB unless given with a K/M/G suffix.\n");
     printf("Options:\n");
-    printf("	-n: number of runs per test (0 to run forever)\n");
+    printf("	-n: number of runs per test (0 to run forever, reporting every --interval until ^C)\n");
     printf("	-a: Don't display average\n");
-    printf("	-t%d: memcpy test\n", TEST_MEMCPY);
-    printf("	-t%d: dumb (b[i]=a[i] style) test\n", TEST_DUMB);
-    printf("	-t%d: memcpy test with fixed block size\n", TEST_MCBLOCK);
-    printf("	-b <size>: block size in bytes for -t2 (default: %d)\n", DEFAULT_BLOCK_SIZE);
+    printf("	-t <tests>: comma separated tests to run, by name or number:\n");
+    for (int i = 0; i < NR_KERNELS; i++)
+        printf("	    %2d %-10s %s%s\n", i, kernels[i].name, kernels[i].desc, kernel_supported(&kernels[i]) ? "" : " (not supported on this CPU)");
+    printf("	-b <size>: block size in bytes for mcblock (default: %d), or a sweep of block sizes\n", DEFAULT_BLOCK_SIZE);
+    printf("	    as for --sweep, e.g. 4K:4M:x2, to run mcblock with each and print the best\n");
     printf("	-q: quiet (print statistics only)\n");
     printf("	-p: number of worker processes (default to 1)\n");
     printf("	-r: number of inner repeats on each test round (default to 3)\n");
     printf("	-f: speecify how each process is pinned in format of 0:3,6,7,8:2:16\n");
-    printf("(will then use two arrays, watch out for swapping)\n");
-    printf("'Bandwidth' is amount of data copied over the time this operation took.\n");
-    printf("\nThe default is to run all tests available.\n");
+    printf("	--latency[=line|page]: pointer-chasing latency test instead of the bandwidth tests,\n");
+    printf("	    one pointer per cache line (default) or per page, working sets from %dK up to array size\n", LATENCY_MIN_SIZE / 1024);
+    printf("	--loaded <cpus>: loaded latency test: workers on these cpus (same format as -f) chase pointers\n");
+    printf("	    through the whole array while the others run the first selected test (memcpy by default)\n");
+    printf("	    in -b sized chunks; granularity as for --latency\n");
+    printf("	--sweep <min:max[:xF|:+step]>: run the tests, or --latency, on growing prefixes of the arrays\n");
+    printf("	    and print one table by working set size, e.g. 4K:1G:x2; the array size defaults to max\n");
+    printf("	--scaling: keep -p pinned workers and run the tests on every worker count and pinning\n");
+    printf("	    stride that fits, printing total and per-worker bandwidth and efficiency vs 1 worker\n");
+    printf("	--sync: all workers start every iteration of every test together (barrier), and the\n");
+    printf("	    aggregate is the total bytes over the wall-clock window, with start/finish skew\n");
+    printf("	--histogram: print a histogram of the samples of each test\n");
+    printf("	--tsc: time with the (calibrated, invariant) TSC instead of CLOCK_MONOTONIC_RAW\n");
+    printf("	--src-node <node>: bind the source array (a) to this NUMA node instead of first touch\n");
+    printf("	--dst-node <node>: bind the destination arrays (b, and c for add/triad) to this NUMA node\n");
+    printf("	--numa-matrix: run the tests (memcpy and read by default) in one process on every NUMA node\n");
+    printf("	    with the arrays bound to every node, and print a cpu node x memory node table\n");
+    printf("	--alloc <backend>[,populate]: how the arrays are allocated: malloc (default), mmap,\n");
+    printf("	    thp (MADV_HUGEPAGE), nothp (MADV_NOHUGEPAGE), hugetlb2m or hugetlb1g (MAP_HUGETLB);\n");
+    printf("	    populate prefaults them (MAP_POPULATE). The pages actually used are reported\n");
+    printf("	--faults: page fault test instead of the bandwidth tests: every worker maps and faults in\n");
+    printf("	    fresh array sized memory, 4K pages or THP, by write or read touches or by\n");
+    printf("	    MADV_POPULATE_WRITE, and a plain mapping by MAP_POPULATE\n");
+    printf("	--cold[=clflush|evict]: evict the arrays from the caches before every pass of a test, with\n");
+    printf("	    clflush (the default on x86) or by writing a buffer of 4x the last level cache\n");
+    printf("	--shared[=static|interleave|steal]: one process, 1 up to -p threads (pinned as with -f)\n");
+    printf("	    running each test together on one set of arrays, split in one contiguous share per\n");
+    printf("	    thread (default), -b sized blocks round robin, or blocks with work stealing\n");
+    printf("	--small[=min:max[:xF|:+step]]: ns per call and bytes per cycle of small copies, hot in the\n");
+    printf("	    cache and with src/dst misaligned, for the copy tests (default: the temporal ones,\n");
+    printf("	    glibc memcpy, dumb as a byte loop), sizes in bytes (default: %s)\n", SMALL_DEFAULT_SIZES);
+    printf("	--src-offset <bytes>, --dst-offset <bytes>: start the source array (a) or the destination\n");
+    printf("	    arrays (b, c) this many bytes after a page boundary\n");
+    printf("	--offset-sweep[=<bytes,...>]: run the tests with every pair of these source and destination\n");
+    printf("	    offsets and print a grid per test (default: %s)\n", OFFSET_DEFAULT_SWEEP);
+    printf("	--stride <bytes>: stride of the stride test and of --index stride (default: %d)\n", DEFAULT_ACCESS_STRIDE);
+    printf("	--index seq|stride|random: order of the index array of gather and scatter (default: random)\n");
+    printf("	--prefetch <bytes>[,nta|t2|t1|t0]: distance and locality hint of the software prefetches\n");
+    printf("	    of the pf_ tests (default: %d,t0)\n", DEFAULT_PREFETCH_DISTANCE);
+    printf("	--prefetch-sweep[=min:max[:xF|:+step]]: run the pf_ tests without prefetches and with every\n");
+    printf("	    distance in the sweep, and print bandwidth by distance (default: %s)\n", PREFETCH_DEFAULT_SWEEP);
+    printf("	--perf: count cycles, instructions, LLC loads and misses and dTLB misses around every sample\n");
+    printf("	    with perf_event_open, and memory controller traffic where allowed; print GHz, IPC,\n");
+    printf("	    bytes per cycle and misses per KiB per worker and in total\n");
+    printf("	--ipc[=min:max[:xF|:+step]]: with -p 2, move messages of each size (default: %s) from the\n",
+           IPC_DEFAULT_SIZES);
+    printf("	    second worker to the first by shared memory, process_vm_readv/writev, pipe, vmsplice\n");
+    printf("	    and sendfile, and print MiB/s and us per message next to memcpy and copy_file_range\n");
+    printf("	    within the first\n");
+    printf("	--c2c: one way latency of a cache line bounced between every pair of -f cpus, as a matrix\n");
+    printf("	--spsc[=min:max[:xF|:+step]]: messages of each size (default: %s) from a producer on the\n",
+           SPSC_DEFAULT_MSGS);
+    printf("	    first -f cpu through a shared ring to a consumer on each other one, in Mmsg/s and GiB/s\n");
+    printf("	--spsc-ring <min:max[:xF|:+step]>: ring sizes of --spsc (default: %s)\n", SPSC_DEFAULT_RINGS);
+    printf("	--auto[=ms]: calibrate -r so that a sample of the quickest test lasts ms (default: %d)\n",
+           AUTO_DEFAULT_MS);
+    printf("	--ci <width>: stop a test once the 95%% confidence interval of a worker's mean bandwidth is\n");
+    printf("	    narrower than width (relative, like 0.01 or 1%%); -n is the most samples (default: %d)\n",
+           CI_MAX_LOOPS);
+    printf("	--budget <seconds>: stop each test of each worker after this long, with -n as above\n");
+    printf("	--json <file>, --csv <file>: also write every sample, the configuration and the host to\n");
+    printf("	    file as JSON or CSV (- for stdout)\n");
+    printf("	--baseline <file>: compare the total bandwidth of each test with a run saved by --json and\n");
+    printf("	    exit with status %d if one is slower by more than --threshold percent (default: %.0lf)\n",
+           EXIT_REGRESSED, BASELINE_DEFAULT_THRESHOLD);
+    printf("	--interval <seconds>: with -n 0, seconds between reports (default: %.1lf)\n", SOAK_DEFAULT_INTERVAL);
+    printf("	--delays <ns,...>: delays injected after each hog chunk, one loaded latency level each\n");
+    printf("	    (default: %s)\n", LOADED_DEFAULT_DELAYS);
+    printf("(will then use two arrays, three for add/triad, watch out for swapping)\n");
+    printf("'App' bandwidth is the amount of data the test reads and writes over the time this operation took,\n");
+    printf("'Bus' bandwidth adds the estimated write-allocate reads of the destination.\n");
+    printf("For stride, gather, scatter and randline they are the 'Useful' data and the whole cache 'Lines' moved.\n");
+    printf("\nThe default is to run all tests available on this CPU, except the access pattern and pf_ ones.\n");
 }
 
 /* ------------------------------------------------------ */
 
-/* allocate a test array and fill it with data
- * so as to force Linux to _really_ allocate it */
-long *make_array(unsigned long long asize)
+/* timing */
+
+/* TSC ticks per second, set by calibrate_tsc(); 0 to use clock_gettime() */
+double tsc_hz = 0;
+
+/* seconds on a clock all the workers share: CLOCK_MONOTONIC_RAW, which
+ * NTP doesn't slew, or the TSC with --tsc */
+double timestamp(void)
 {
-    unsigned long long t;
-    unsigned int long_size = sizeof(long);
-    long *a;
+    struct timespec t;
+#ifdef HAVE_X86
+    if (tsc_hz)
+        return __rdtsc() / tsc_hz;
+#endif
+    clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* measure the TSC frequency against CLOCK_MONOTONIC_RAW over 'ms'
+ * milliseconds. Only an invariant TSC ticks at a constant rate in
+ * every power state and on every core, so refuse anything else.
+ *
+ * return value: 0 on success, -1 if the TSC can't be used
+ */
+int calibrate_tsc(int ms)
+{
+#ifdef HAVE_X86
+    unsigned int eax, ebx, ecx, edx;
+    double t0, t1;
+    unsigned long long c0, c1;
+
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 8)))
+        return -1;
+    tsc_hz = 0;
+    t0 = timestamp();
+    c0 = __rdtsc();
+    do
+    {
+        t1 = timestamp();
+    } while (t1 - t0 < ms * 1e-3);
+    c1 = __rdtsc();
+    tsc_hz = (c1 - c0) / (t1 - t0);
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+/* ------------------------------------------------------ */
+
+/* NUMA placement, with raw syscalls: libnuma doesn't link -static */
+
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+#ifndef MPOL_MF_STRICT
+#define MPOL_MF_STRICT (1 << 0)
+#define MPOL_MF_MOVE (1 << 1)
+#endif
+
+/* parse a sysfs list like "0-3,8-11" into 'out', at most max entries
+ *
+ * return value: number of entries, -1 if it can't be parsed
+ */
+int parse_sysfs_list(int *out, int max, const char *str)
+{
+    int n = 0;
+    const char *p = str;
+    while (*p && *p != '\n')
+    {
+        char *end;
+        long lo = strtol(p, &end, 10), hi;
+        if (end == p || lo < 0)
+            return -1;
+        hi = lo;
+        if (*end == '-')
+        {
+            p = end + 1;
+            hi = strtol(p, &end, 10);
+            if (end == p || hi < lo)
+                return -1;
+        }
+        for (long i = lo; i <= hi && n < max; i++)
+            out[n++] = i;
+        p = *end == ',' ? end + 1 : end;
+    }
+    return n;
+}
+
+/* read one sysfs list file, see parse_sysfs_list(); -1 if unreadable */
+int read_sysfs_list(int *out, int max, const char *path)
+{
+    char buf[4096];
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return -1;
+    if (!fgets(buf, sizeof(buf), f))
+    {
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    return parse_sysfs_list(out, max, buf);
+}
+
+/* the online NUMA nodes; a kernel without NUMA support has node 0 only
+ *
+ * return value: number of nodes stored in 'nodes'
+ */
+int numa_online_nodes(int *nodes, int max)
+{
+    int n = read_sysfs_list(nodes, max, "/sys/devices/system/node/online");
+    if (n <= 0)
+    {
+        nodes[0] = 0;
+        n = 1;
+    }
+    return n;
+}
+
+/* is 'node' one of the online nodes? */
+int numa_node_online(int node)
+{
+    int nodes[MAX_NUMA_NODES];
+    int n = numa_online_nodes(nodes, MAX_NUMA_NODES);
+    if (node < 0 || node >= MAX_NUMA_NODES)
+        return 0;
+    for (int i = 0; i < n; i++)
+        if (nodes[i] == node)
+            return 1;
+    return 0;
+}
+
+/* cpus of a NUMA node; all cpus we may run on if the kernel doesn't know
+ *
+ * return value: number of cpus in 'set'
+ */
+int numa_node_cpus(int node, cpu_set_t *set)
+{
+    static int cpus[CPU_SETSIZE];
+    char path[64];
+    int n;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    n = read_sysfs_list(cpus, CPU_SETSIZE, path);
+    if (n < 0)
+        return sched_getaffinity(0, sizeof(*set), set) ? 0 : CPU_COUNT(set);
+    CPU_ZERO(set);
+    for (int i = 0; i < n; i++)
+        CPU_SET(cpus[i], set);
+    return n;
+}
+
+/* bind not yet touched memory to one node: its pages are only ever
+ * allocated there, or not at all
+ *
+ * return value: 0 on success, -1 with errno set
+ */
+int numa_bind(void *addr, size_t len, int node)
+{
+    unsigned long mask[MAX_NUMA_NODES / (8 * sizeof(unsigned long))];
+
+    memset(mask, 0, sizeof(mask));
+    mask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+    /* the kernel takes one more than the number of bits in the mask */
+    return syscall(SYS_mbind, addr, len, MPOL_BIND, mask, 8 * sizeof(mask) + 1, MPOL_MF_STRICT | MPOL_MF_MOVE);
+}
+
+/* ------------------------------------------------------ */
+
+/* allocation backends of the test arrays, --alloc; the index is the
+ * backend number, ALLOC_POPULATE may be or'ed in */
+enum
+{
+    ALLOC_MALLOC,     /* calloc, whatever the host's THP policy does */
+    ALLOC_MMAP,       /* a private anonymous mapping of its own */
+    ALLOC_THP,        /* mmap, 2M aligned, MADV_HUGEPAGE */
+    ALLOC_NOTHP,      /* mmap, MADV_NOHUGEPAGE */
+    ALLOC_HUGETLB_2M, /* MAP_HUGETLB from the 2M pool */
+    ALLOC_HUGETLB_1G, /* MAP_HUGETLB from the 1G pool */
+};
+#define ALLOC_POPULATE 0x100 /* prefault with MAP_POPULATE */
+#define ALLOC_BACKEND(x) ((x) & ~ALLOC_POPULATE)
+
+const char *alloc_names[] = {"malloc", "mmap", "thp", "nothp", "hugetlb2m", "hugetlb1g"};
+
+#define THP_SIZE (2ULL << 20)
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+/* parse "backend[,populate]" for --alloc
+ *
+ * return value: the backend, -1 if there is no such backend
+ */
+int parse_alloc(const char *str)
+{
+    int len = strcspn(str, ",");
+    int backend = -1;
+    for (int i = 0; i < (int)(sizeof(alloc_names) / sizeof(alloc_names[0])); i++)
+        if ((int)strlen(alloc_names[i]) == len && !strncasecmp(str, alloc_names[i], len))
+            backend = i;
+    if (backend < 0 || !str[len])
+        return backend;
+    if (strcasecmp(str + len + 1, "populate"))
+        return -1;
+    /* calloc can't prefault, use a mapping of our own for that */
+    return (backend == ALLOC_MALLOC ? ALLOC_MMAP : backend) | ALLOC_POPULATE;
+}
+
+/* bytes the mapping of an array really takes: hugetlb rounds up */
+unsigned long long alloc_bytes(unsigned long long bytes, int backend)
+{
+    unsigned long long page = 4096;
+    if (ALLOC_BACKEND(backend) == ALLOC_HUGETLB_2M)
+        page = 2ULL << 20;
+    else if (ALLOC_BACKEND(backend) == ALLOC_HUGETLB_1G)
+        page = 1ULL << 30;
+    return (bytes + page - 1) & ~(page - 1);
+}
+
+/* allocate an array without touching it (unless populating)
+ * node: NUMA node to bind the array to, -1 for first touch
+ * backend: ALLOC_*, optionally with ALLOC_POPULATE
+ *
+ * return value: the array, NULL on failure
+ */
+long *alloc_array(unsigned long long bytes, int node, int backend)
+{
+    unsigned int long_size = sizeof(long);
+    unsigned long long asize = (bytes + long_size - 1) / long_size;
+    unsigned long long len = alloc_bytes(asize * long_size, backend);
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    long *a;
+
+    /* mbind() works on whole pages, so a bound array gets its own */
+    if (ALLOC_BACKEND(backend) == ALLOC_MALLOC && node >= 0)
+        backend = ALLOC_MMAP;
+
+    if (ALLOC_BACKEND(backend) == ALLOC_MALLOC)
+    {
+        a = calloc(asize, long_size);
+        if (NULL == a)
+        {
+            perror("Error allocating memory");
+            return NULL;
+        }
+    }
+    else
+    {
+        if (ALLOC_BACKEND(backend) == ALLOC_HUGETLB_2M)
+            flags |= MAP_HUGETLB | (21 << MAP_HUGE_SHIFT);
+        else if (ALLOC_BACKEND(backend) == ALLOC_HUGETLB_1G)
+            flags |= MAP_HUGETLB | (30 << MAP_HUGE_SHIFT);
+        /* populating before mbind() would put the pages on the wrong node,
+         * before MADV_HUGEPAGE in small pages and before MADV_NOHUGEPAGE
+         * in huge ones when THP is "always" */
+        if ((backend & ALLOC_POPULATE) && node < 0 && ALLOC_BACKEND(backend) != ALLOC_THP &&
+            ALLOC_BACKEND(backend) != ALLOC_NOTHP)
+            flags |= MAP_POPULATE;
+
+        if (ALLOC_BACKEND(backend) == ALLOC_THP)
+        {
+            /* huge pages need 2M aligned virtual memory: over-allocate and trim */
+            char *p = mmap(NULL, len + THP_SIZE, PROT_READ | PROT_WRITE, flags, -1, 0);
+            if (p == MAP_FAILED)
+                a = MAP_FAILED;
+            else
+            {
+                char *aligned = (char *)(((uintptr_t)p + THP_SIZE - 1) & ~(THP_SIZE - 1));
+                if (aligned > p)
+                    munmap(p, aligned - p);
+                munmap(aligned + len, p + THP_SIZE - aligned);
+                a = (long *)aligned;
+                if (madvise(a, len, MADV_HUGEPAGE) < 0)
+                    perror("Warning: madvise(MADV_HUGEPAGE)");
+            }
+        }
+        else
+        {
+            a = mmap(NULL, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+            if (a != MAP_FAILED && ALLOC_BACKEND(backend) == ALLOC_NOTHP && madvise(a, len, MADV_NOHUGEPAGE) < 0)
+                perror("Warning: madvise(MADV_NOHUGEPAGE)");
+        }
+        if (a == MAP_FAILED)
+        {
+            fprintf(stderr, "Error allocating memory with %s: %s%s\n", alloc_names[ALLOC_BACKEND(backend)], strerror(errno),
+                    (flags & MAP_HUGETLB) ? " (are there enough free huge pages of that size? see /proc/sys/vm/nr_hugepages)" : "");
+            return NULL;
+        }
+        if (node >= 0 && numa_bind(a, len, node) < 0)
+        {
+            fprintf(stderr, "Error binding memory to node %d: %s\n", node, strerror(errno));
+            munmap(a, len);
+            return NULL;
+        }
+        /* THP, NOTHP or a bound mapping could not use MAP_POPULATE;
+         * MADV_POPULATE_WRITE needs 5.14, before that touch every page */
+        if ((backend & ALLOC_POPULATE) && !(flags & MAP_POPULATE) && madvise(a, len, MADV_POPULATE_WRITE) < 0)
+        {
+            static int warned = 0;
+            if (!warned)
+            {
+                fprintf(stderr, "Warning: madvise(MADV_POPULATE_WRITE): %s, populating by touching the pages\n",
+                        strerror(errno));
+                warned = 1;
+            }
+            for (unsigned long long off = 0; off < len; off += 4096)
+                ((volatile char *)a)[off] = 0;
+        }
+    }
+    return a;
+}
+
+/* allocate a test array and fill it with data
+ * so as to force Linux to _really_ allocate it
+ * node, backend: as for alloc_array()
+ *
+ * return value: the array, NULL on failure
+ */
+long *make_array(unsigned long long asize, int node, int backend)
+{
+    unsigned long long t;
+    long *a = alloc_array(asize * sizeof(long), node, backend);
+
+    if (NULL == a)
+        return NULL;
+
+    /* make sure both arrays are allocated, fill with pattern */
+    for (t = 0; t < asize; t++)
+    {
+        a[t] = 0xaa;
+    }
+    return a;
+}
+
+/* free an array from make_array() */
+void free_array(long *a, unsigned long long asize, int node, int backend)
+{
+    if (ALLOC_BACKEND(backend) == ALLOC_MALLOC && node < 0)
+        free(a);
+    else
+        munmap(a, alloc_bytes(asize * sizeof(long), backend));
+}
+
+/* what the kernel actually gave us for the mapping that holds 'addr',
+ * from /proc/self/smaps: where the mapping starts, resident, in
+ * transparent huge pages, in hugetlb pages (all in KiB), and the page
+ * size of the mapping
+ *
+ * return value: 0 on success, -1 if the mapping wasn't found
+ */
+int smaps_pages(const void *addr, unsigned long long *vma_start, unsigned long long *rss_kb, unsigned long long *thp_kb,
+                unsigned long long *hugetlb_kb, unsigned long long *page_kb)
+{
+    char line[512];
+    int found = 0;
+    FILE *f = fopen("/proc/self/smaps", "r");
+    if (!f)
+        return -1;
+    *rss_kb = *thp_kb = *hugetlb_kb = 0;
+    *page_kb = 4;
+    while (fgets(line, sizeof(line), f))
+    {
+        unsigned long long start, end, kb;
+        if (sscanf(line, "%llx-%llx ", &start, &end) == 2 && strchr(line, '-') < strchr(line, ' '))
+        {
+            if (found)
+                break;
+            found = (uintptr_t)addr >= start && (uintptr_t)addr < end;
+            *vma_start = start;
+        }
+        else if (!found)
+            continue;
+        else if (sscanf(line, "Rss: %llu kB", &kb) == 1)
+            *rss_kb = kb;
+        else if (sscanf(line, "AnonHugePages: %llu kB", &kb) == 1)
+            *thp_kb = kb;
+        else if (sscanf(line, "Private_Hugetlb: %llu kB", &kb) == 1 || sscanf(line, "Shared_Hugetlb: %llu kB", &kb) == 1)
+            *hugetlb_kb += kb;
+        else if (sscanf(line, "KernelPageSize: %llu kB", &kb) == 1)
+            *page_kb = kb;
+    }
+    fclose(f);
+    return found ? 0 : -1;
+}
+
+/* print which pages the arrays of one worker ended up in */
+void report_pages(int procno, long **arrays, int nr_arrays, unsigned long long bytes, int backend)
+{
+    unsigned long long rss = 0, thp = 0, hugetlb = 0, page_kb = 4;
+    unsigned long long vmas[3];
+    for (int i = 0; i < nr_arrays; i++)
+    {
+        unsigned long long r, t, h;
+        int seen = 0;
+        if (smaps_pages(arrays[i], &vmas[i], &r, &t, &h, &page_kb) < 0)
+        {
+            printf("worker %d: can't find the arrays in /proc/self/smaps\n", procno);
+            return;
+        }
+        /* neighbouring mappings with the same flags merge into one */
+        for (int j = 0; j < i; j++)
+            seen |= vmas[j] == vmas[i];
+        if (seen)
+            continue;
+        rss += r;
+        thp += t;
+        hugetlb += h;
+    }
+    printf("worker %d: --alloc %s%s: ", procno, alloc_names[ALLOC_BACKEND(backend)],
+           (backend & ALLOC_POPULATE) ? ",populate" : "");
+    if (hugetlb)
+        printf("%llu KiB in %lluK hugetlb pages\n", hugetlb, page_kb);
+    else
+        printf("%llu KiB resident, %llu KiB (%.1lf%% of the arrays) in transparent huge pages\n", rss, thp,
+               100.0 * thp * 1024 / (bytes * nr_arrays));
+}
+
+/* size of the --cold=evict buffer: a few times the last level cache */
+unsigned long long evict_size(void)
+{
+    long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (llc <= 0)
+        llc = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    return llc > 0 ? 4ULL * llc : COLD_EVICT_FALLBACK;
+}
+
+/* --cold: get the arrays of a test out of the caches */
+void make_cold(const struct kernel *k, const struct kernel_args *ka)
+{
+#ifdef HAVE_X86
+    if (ka->cold == COLD_CLFLUSH)
+    {
+        long *arrays[3] = {ka->a, ka->b, ka->c};
+        for (int i = 0; i < k->nr_arrays; i++)
+        {
+            char *p = (char *)arrays[i];
+            for (unsigned long long off = 0; off < ka->array_bytes; off += 64)
+                _mm_clflush(p + off);
+            _mm_clflush(p + ka->array_bytes - 1);
+        }
+        _mm_mfence();
+        return;
+    }
+#endif
+    /* write a buffer much larger than the caches, one store per line */
+    volatile char *e = ka->evict;
+    for (unsigned long long off = 0; off < ka->evict_bytes; off += 64)
+        e[off]++;
+}
+
+/* one pass of a kernel over the arrays */
+static inline void run_kernel(const struct kernel *k, struct kernel_args *ka, int rep)
+{
+    ka->rep = rep;
+    if (k->copy)
+        k->copy(ka->b, ka->a, ka->array_bytes);
+    else
+        k->run(ka);
+}
+
+/* actual benchmark */
+/* k: kernel to run
+ * ka: test arrays and sizes
+ * repeats: how many passes over the arrays to time together
+ *
+ * return value: elapsed time in seconds
+ */
+double worker(const struct kernel *k, struct kernel_args *ka, int repeats)
+{
+    double starttime, endtime;
+
+    if (ka->cold)
+    {
+        /* time every pass on its own, with cold caches before each */
+        double elapsed = 0;
+        for (int rep = 0; rep < repeats; rep++)
+        {
+            make_cold(k, ka);
+            starttime = timestamp();
+            run_kernel(k, ka, rep);
+            elapsed += timestamp() - starttime;
+        }
+        return elapsed;
+    }
+
+    starttime = timestamp();
+    for (int rep = 0; rep < repeats; rep++)
+        run_kernel(k, ka, rep);
+    endtime = timestamp();
+
+    return endtime - starttime;
+}
+
+/* ------------------------------------------------------ */
+
+/* hardware counters with perf_event_open(2), per worker around every
+ * sample, and the memory controllers system wide where we may */
+
+struct perf_event_desc
+{
+    const char *name;
+    unsigned int type;
+    unsigned long long config;
+};
+
+#define PERF_CACHE(cache, result) \
+    ((cache) | PERF_COUNT_HW_CACHE_OP_READ << 8 | (unsigned long long)(result) << 16)
+
+enum
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_LOADS,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    NR_PERF_EVENTS,
+};
+
+struct perf_event_desc perf_events[NR_PERF_EVENTS] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"LLC-loads", PERF_TYPE_HW_CACHE, PERF_CACHE(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_RESULT_ACCESS)},
+    {"LLC-load-misses", PERF_TYPE_HW_CACHE, PERF_CACHE(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {"dTLB-load-misses", PERF_TYPE_HW_CACHE, PERF_CACHE(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+};
+
+/* one worker's counters: fds[e] is -1 if event e can't be counted,
+ * counts gets the sum over the samples of each test */
+struct perf_counters
+{
+    int fds[NR_PERF_EVENTS];
+    volatile double *counts; /* [test][event] */
+};
+
+/* most memory controller counters we read */
+#define MAX_IMC_COUNTERS 256
+
+/* memory controller read and write CAS counters, all uncore_imc PMUs */
+struct imc_counters
+{
+    int nr;
+    int fds[MAX_IMC_COUNTERS];
+    int write[MAX_IMC_COUNTERS]; /* counts writes, else reads */
+    double scale[MAX_IMC_COUNTERS]; /* MiB per count */
+};
+
+static long perf_event_open(struct perf_event_attr *attr, pid_t pid, int cpu, int group_fd, unsigned long flags)
+{
+    return syscall(SYS_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+int perf_paranoid(void)
+{
+    int level = 2;
+    FILE *f = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+    if (f)
+    {
+        if (fscanf(f, "%d", &level) != 1)
+            level = 2;
+        fclose(f);
+    }
+    return level;
+}
+
+/* open a disabled counter, counting the kernel too unless we may not
+ *
+ * return value: the fd, -1 with errno set
+ */
+int perf_open(unsigned int type, unsigned long long config, pid_t pid, int cpu)
+{
+    struct perf_event_attr attr;
+    int fd;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_hv = 1;
+    /* multiplexed counters are scaled up to the whole time enabled */
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    fd = perf_event_open(&attr, pid, cpu, -1, 0);
+    if (fd < 0 && (errno == EACCES || errno == EPERM) && pid >= 0)
+    {
+        attr.exclude_kernel = 1;
+        fd = perf_event_open(&attr, pid, cpu, -1, 0);
+    }
+    return fd;
+}
+
+/* open the counters of this worker; the first worker says what's missing
+ *
+ * return value: number of events that can be counted
+ */
+int perf_open_worker(struct perf_counters *pc, int procno, int nr_tests)
+{
+    int nr = 0;
+    for (int e = 0; e < NR_PERF_EVENTS; e++)
+    {
+        pc->fds[e] = perf_open(perf_events[e].type, perf_events[e].config, 0, -1);
+        if (pc->fds[e] >= 0)
+            nr++;
+        else
+        {
+            for (int k = 0; k < nr_tests; k++)
+                pc->counts[k * NR_PERF_EVENTS + e] = NAN;
+            if (procno == 1)
+                printf("perf: can't count %s: %s (perf_event_paranoid is %d)\n", perf_events[e].name,
+                       strerror(errno), perf_paranoid());
+        }
+    }
+    fflush(stdout);
+    return nr;
+}
+
+void perf_start(int *fds, int nr)
+{
+    for (int e = 0; e < nr; e++)
+    {
+        if (fds[e] < 0)
+            continue;
+        ioctl(fds[e], PERF_EVENT_IOC_RESET, 0);
+        ioctl(fds[e], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+/* stop the counters and add what they counted to 'counts'; NAN for the
+ * ones we don't have */
+void perf_stop(int *fds, int nr, volatile double *counts)
+{
+    for (int e = 0; e < nr; e++)
+    {
+        unsigned long long v[3]; /* value, time enabled, time running */
+        if (fds[e] >= 0)
+            ioctl(fds[e], PERF_EVENT_IOC_DISABLE, 0);
+        if (fds[e] < 0 || read(fds[e], v, sizeof(v)) != sizeof(v))
+            counts[e] = NAN;
+        else if (v[2])
+            counts[e] += (double)v[0] * v[1] / v[2];
+    }
+}
+
+/* read a sysfs file of a PMU into buf, -1 if there is none */
+int pmu_read(const char *pmu, const char *file, char *buf, int size)
+{
+    char path[256];
+    FILE *f;
+    snprintf(path, sizeof(path), "/sys/bus/event_source/devices/%s/%s", pmu, file);
+    f = fopen(path, "r");
+    if (!f)
+        return -1;
+    if (!fgets(buf, size, f))
+        buf[0] = '\0';
+    fclose(f);
+    return 0;
+}
+
+/* parse an event description like "event=0x04,umask=0x03" into a config,
+ * with the usual event:0-7, umask:8-15 layout */
+unsigned long long pmu_config(const char *desc)
+{
+    unsigned long long config = 0, v;
+    const char *p;
+    if ((p = strstr(desc, "event=")) && sscanf(p, "event=%lli", &v) == 1)
+        config |= v;
+    if ((p = strstr(desc, "umask=")) && sscanf(p, "umask=%lli", &v) == 1)
+        config |= v << 8;
+    return config;
+}
+
+/* open the CAS counters of every memory controller, once on every cpu
+ * in the cpumask of its PMU: that is one cpu per socket, and each only
+ * counts the controllers of its own socket. Needs CAP_PERFMON or
+ * perf_event_paranoid <= 0
+ *
+ * return value: number of counters opened
+ */
+int imc_open(struct imc_counters *ic)
+{
+    static const char *events[] = {"cas_count_read", "cas_count_write"};
+    static int cpus[CPU_SETSIZE];
+    char buf[256], path[256];
+    for (int i = 0; ic->nr + 2 <= MAX_IMC_COUNTERS; i++)
+    {
+        char pmu[32], file[64];
+        int type, nr_cpus;
+        snprintf(pmu, sizeof(pmu), "uncore_imc_%d", i);
+        if (pmu_read(pmu, "type", buf, sizeof(buf)) < 0)
+            break;
+        type = atoi(buf);
+        snprintf(path, sizeof(path), "/sys/bus/event_source/devices/%s/cpumask", pmu);
+        nr_cpus = read_sysfs_list(cpus, CPU_SETSIZE, path);
+        if (nr_cpus <= 0)
+        {
+            cpus[0] = 0;
+            nr_cpus = 1;
+        }
+        for (int w = 0; w < 2; w++)
+        {
+            snprintf(file, sizeof(file), "events/%s", events[w]);
+            if (pmu_read(pmu, file, buf, sizeof(buf)) < 0)
+                continue;
+            unsigned long long config = pmu_config(buf);
+            double scale = 64.0 / 1024 / 1024;
+            snprintf(file, sizeof(file), "events/%s.scale", events[w]);
+            if (pmu_read(pmu, file, buf, sizeof(buf)) == 0)
+                scale = atof(buf);
+            for (int c = 0; c < nr_cpus && ic->nr < MAX_IMC_COUNTERS; c++)
+            {
+                int fd = perf_open(type, config, -1, cpus[c]);
+                if (fd < 0)
+                    continue;
+                ic->scale[ic->nr] = scale;
+                ic->write[ic->nr] = w;
+                ic->fds[ic->nr++] = fd;
+            }
+        }
+    }
+    return ic->nr;
+}
+
+/* memory controller traffic in MiB since perf_start() */
+void imc_stop(struct imc_counters *ic, double *read_mib, double *write_mib)
+{
+    double counts[MAX_IMC_COUNTERS];
+    memset(counts, 0, sizeof(counts));
+    perf_stop(ic->fds, ic->nr, counts);
+    *read_mib = *write_mib = 0;
+    for (int i = 0; i < ic->nr; i++)
+    {
+        if (ic->write[i])
+            *write_mib += counts[i] * ic->scale[i];
+        else
+            *read_mib += counts[i] * ic->scale[i];
+    }
+}
+
+/* ------------------------------------------------------ */
+
+/* pretty print worker's output in human-readable terms */
+/* te: elapsed time in seconds
+ * mt: size of one array pass in MiB (array size times repeats)
+ * k: kernel that was run
+ *
+ * return value: -
+ */
+void printout(double te, double mt, const struct kernel *k)
+{
+    printf("Method: %s\t", k->name);
+    printf("Elapsed: %.5f\t", te);
+    printf("MiB: %.5f\t", mt * kernel_app_arrays(k));
+    printf("%s: %.3f MiB/s\t", k->traffic ? "Useful" : "App", mt * kernel_app_arrays(k) / te);
+    printf("%s: %.3f MiB/s\n", k->traffic ? "Lines" : "Bus", mt * kernel_bus_arrays(k) / te);
+    return;
+}
+
+/* --ci/--budget: when a worker may stop running a test early */
+struct convergence
+{
+    double ci;            /* relative half width of the 95% confidence interval to reach, 0 for none */
+    double budget;        /* seconds per test, 0 for none */
+    volatile int *counts; /* samples taken of each test */
+};
+
+/* two-sided 95% quantile of Student's t distribution */
+double t95(int df)
+{
+    static const double t[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                               2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                               2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    if (df < 1)
+        return INFINITY;
+    return df <= (int)(sizeof(t) / sizeof(t[0])) ? t[df - 1] : 1.960;
+}
+
+/* half width of the 95% confidence interval of the mean of n samples,
+ * relative to the mean, from their sum and sum of squares */
+double ci_relative(int n, double sum, double sumsq)
+{
+    if (n < 2 || sum <= 0)
+        return INFINITY;
+    double mean = sum / n, var = fmax(0, (sumsq - sum * sum / n) / (n - 1));
+    return t95(n - 1) * sqrt(var / n) / mean;
+}
+
+/* time one sample of every test with a single repeat, after a warm-up,
+ * and find how many repeats make the quickest of them last 'target'
+ * seconds */
+int calibrate_repeats(struct kernel_args *ka, const int *sel, int nr_tests, double target)
+{
+    double fastest = 0;
+    for (int k = 0; k < nr_tests; k++)
+    {
+        const struct kernel *kn = &kernels[sel[k]];
+        worker(kn, ka, 1);
+        double te = worker(kn, ka, 1);
+        fastest = k == 0 || te < fastest ? te : fastest;
+    }
+    double repeats = ceil(target / fastest);
+    return repeats < 1 ? 1 : repeats > INT_MAX ? INT_MAX : (int)repeats;
+}
+
+/* run all tests requested, the proper number of times
+ * results: row 0 gets the average time of each test, rows 1..nr_loops
+ * the samples; may be NULL when running forever (nr_loops == 0)
+ * pc: counters to run around every sample, NULL for none
+ * conv: stop a test once it converged or ran out of time, nr_loops
+ * being the most samples then; NULL to always take nr_loops
+ */
+void bandwidth_worker(int procno, struct kernel_args *ka, const int *sel, int nr_tests, int nr_loops,
+                      int nr_repeats, double mt, int quiet, int showavg, volatile double *results,
+                      struct perf_counters *pc, const struct convergence *conv)
+{
+    for (int k = 0; k < nr_tests; k++)
+    {
+        const struct kernel *kn = &kernels[sel[k]];
+        double te, te_sum = 0, bw_sum = 0, bw_sumsq = 0, starttime = timestamp();
+        int n = nr_loops;
+        for (int i = 0; nr_loops == 0 || i < nr_loops; i++)
+        {
+            if (pc)
+                perf_start(pc->fds, NR_PERF_EVENTS);
+            te = worker(kn, ka, nr_repeats);
+            if (pc)
+                perf_stop(pc->fds, NR_PERF_EVENTS, pc->counts + k * NR_PERF_EVENTS);
+            te_sum += te;
+            if (!quiet)
+            {
+                printf("worker %d\t%d\t", procno, i);
+                printout(te, mt * nr_repeats, kn);
+            }
+            //putchar('.');
+            if (nr_loops)
+                results[(i + 1) * nr_tests + k] = te;
+            if (conv)
+            {
+                double bw = mt * nr_repeats / te;
+                bw_sum += bw;
+                bw_sumsq += bw * bw;
+                if ((i + 1 >= CI_MIN_SAMPLES && ci_relative(i + 1, bw_sum, bw_sumsq) < conv->ci) ||
+                    (conv->budget && timestamp() - starttime >= conv->budget))
+                {
+                    n = i + 1;
+                    break;
+                }
+            }
+        }
+        if (conv)
+            conv->counts[k] = n;
+        if (showavg && !quiet)
+        {
+            printf("worker %d\tAVG\t", procno);
+            printout(te_sum / n, mt * nr_repeats, kn);
+        }
+        results[k] = te_sum / n;
+    }
+}
+
+/* ------------------------------------------------------ */
+
+/* sample statistics */
+
+struct stats
+{
+    int n;
+    double mean, stddev, cv; /* cv: stddev / mean */
+    double min, median, p90, p99, max;
+    double p10, p1; /* the low tail, the slow one for speeds */
+};
+
+int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* p-th percentile (0..100) of sorted v, interpolating between samples */
+double percentile(const double *v, int n, double p)
+{
+    double pos = p / 100 * (n - 1);
+    int i = (int)pos;
+    if (i >= n - 1)
+        return v[n - 1];
+    return v[i] + (pos - i) * (v[i + 1] - v[i]);
+}
+
+/* statistics of n samples; sorts v in place. The std-dev is the sample
+ * std-dev of the n values (n - 1 in the denominator). */
+void compute_stats(struct stats *st, double *v, int n)
+{
+    double sum = 0, sumsq = 0;
+    qsort(v, n, sizeof(double), compare_doubles);
+    for (int i = 0; i < n; i++)
+    {
+        sum += v[i];
+        sumsq += v[i] * v[i];
+    }
+    st->n = n;
+    st->mean = sum / n;
+    st->stddev = n > 1 ? sqrt(fmax(0, (sumsq - sum * sum / n) / (n - 1))) : 0;
+    st->cv = st->mean ? st->stddev / st->mean : 0;
+    st->min = v[0];
+    st->median = percentile(v, n, 50);
+    st->p90 = percentile(v, n, 90);
+    st->p99 = percentile(v, n, 99);
+    st->p10 = percentile(v, n, 10);
+    st->p1 = percentile(v, n, 1);
+    st->max = v[n - 1];
+}
+
+/* ASCII histogram of n samples in 'bins' equal-width bins */
+void print_histogram(const double *v, int n, int bins, const char *unit)
+{
+    double lo = v[0], hi = v[0];
+    int *count = calloc(bins, sizeof(int));
+    int most = 0;
+
+    for (int i = 1; i < n; i++)
+    {
+        lo = v[i] < lo ? v[i] : lo;
+        hi = v[i] > hi ? v[i] : hi;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        int b = hi > lo ? (int)((v[i] - lo) / (hi - lo) * bins) : 0;
+        if (b >= bins)
+            b = bins - 1;
+        if (++count[b] > most)
+            most = count[b];
+    }
+    for (int b = 0; b < bins; b++)
+    {
+        printf("  %12.2lf - %12.2lf %s %6d ", lo + (hi - lo) * b / bins, lo + (hi - lo) * (b + 1) / bins, unit, count[b]);
+        for (int j = 0; j < count[b] * HISTOGRAM_WIDTH / most; j++)
+            putchar('#');
+        printf("\n");
+    }
+    free(count);
+}
+
+/* controller side of the bandwidth tests: the raw samples of every
+ * worker, distribution statistics per worker and over all samples,
+ * and the total over the workers
+ */
+void bandwidth_report(volatile double **mpresults, volatile int **mpcounts, int nr_procs, const int *sel,
+                      int nr_tests, int nr_loops, int nr_repeats, double mt, double total_run_time, int histogram)
+{
+    /* app bandwidth of every sample: [test][worker - 1][loop] */
+    double *speeds = malloc(sizeof(double) * nr_tests * nr_procs * nr_loops);
+    double *idletime = malloc(sizeof(double) * nr_procs);
+#define SPEEDS(k, i) (speeds + ((k) * nr_procs + (i)) * nr_loops)
+/* samples worker i (0-based) took of test k: all of them, unless --ci stopped early */
+#define COUNT(k, i) (mpcounts ? mpcounts[(i) + 1][k] : nr_loops)
+
+    for (int i = 1; i <= nr_procs; i++)
+    {
+        double worker_run_time = 0;
+        printf("Worker #%d\n", i);
+        for (int k = 0; k < nr_tests; k++)
+        {
+            for (int j = 0; j <= COUNT(k, i - 1); j++)
+            {
+                printf("%8.6lf\t", mpresults[i][j * nr_tests + k]);
+            }
+            worker_run_time += mpresults[i][k] * COUNT(k, i - 1);
+            printf("\n");
+        }
+        for (int k = 0; k < nr_tests; k++)
+        {
+            /* MiB moved by one sample, as the application sees it */
+            double app_mib = mt * nr_repeats * kernel_app_arrays(&kernels[sel[k]]);
+            for (int j = 0; j <= COUNT(k, i - 1); j++)
+            {
+                double speed = app_mib / mpresults[i][j * nr_tests + k];
+                printf("%8.3lf\t", speed);
+                if (j)
+                    SPEEDS(k, i - 1)[j - 1] = speed;
+            }
+            printf("\n");
+        }
+        idletime[i - 1] = total_run_time - worker_run_time;
+        printf("Worker idle time: %8.3lf\n", idletime[i - 1]);
+    }
+
+    printf("\nSpeed statistics (app MiB/s; p10/p1 are the 10th/1st percentile speed, i.e. the slow tail):\n");
+    printf("%-10s %6s %10s %10s %6s %10s %10s %10s %10s %10s\n", "", "worker", "mean", "std-dev", "cv%",
+           "best", "median", "p10", "p1", "worst");
+    for (int k = 0; k < nr_tests; k++)
+    {
+        struct stats st;
+        double *all = malloc(sizeof(double) * nr_procs * nr_loops);
+        int nr_all = 0;
+        for (int i = 0; i < nr_procs; i++)
+        {
+            memcpy(all + nr_all, SPEEDS(k, i), sizeof(double) * COUNT(k, i));
+            nr_all += COUNT(k, i);
+        }
+        /* i == nr_procs: all samples of all workers */
+        for (int i = 0; i <= nr_procs && (i < nr_procs || nr_procs > 1); i++)
+        {
+            double *v = i < nr_procs ? SPEEDS(k, i) : all;
+            int n = i < nr_procs ? COUNT(k, i) : nr_all;
+            compute_stats(&st, v, n);
+            printf("%-10s ", kernels[sel[k]].name);
+            if (i < nr_procs)
+                printf("%6d", i + 1);
+            else
+                printf("%6s", "all");
+            /* the slow tail of the times is the low end of the speeds */
+            printf(" %10.2lf %10.2lf %6.2lf %10.2lf %10.2lf %10.2lf %10.2lf %10.2lf\n", st.mean, st.stddev, st.cv * 100,
+                   st.max, st.median, st.p10, st.p1, st.min);
+        }
+        if (histogram)
+            print_histogram(all, nr_all, HISTOGRAM_BINS, "MiB/s");
+        free(all);
+    }
+
+    printf("\nTotal speed (app MiB/s, std-dev, estimated bus MiB/s):\n");
+    for (int k = 0; k < nr_tests; k++)
+    {
+        const struct kernel *kn = &kernels[sel[k]];
+        double sum = 0, var = 0;
+        for (int i = 0; i < nr_procs; i++)
+        {
+            struct stats st;
+            compute_stats(&st, SPEEDS(k, i), COUNT(k, i));
+            sum += st.mean;
+            /* the workers are independent: variances add up */
+            var += st.stddev * st.stddev;
+        }
+        printf("%-10s %10.2lf %8.2lf %10.2lf\n", kn->name, sum, sqrt(var), sum * kernel_bus_arrays(kn) / kernel_app_arrays(kn));
+    }
+    printf("Idle time per worker:");
+    for (int i = 0; i < nr_procs; i++)
+    {
+        printf(" %7.3lf", idletime[i]);
+    }
+    printf("\n");
+    if (mpcounts)
+    {
+        printf("\nSamples per worker and the half width of the 95%% confidence interval of the mean:\n");
+        for (int k = 0; k < nr_tests; k++)
+        {
+            printf("%-10s", kernels[sel[k]].name);
+            for (int i = 0; i < nr_procs; i++)
+            {
+                double sum = 0, sumsq = 0;
+                for (int j = 0; j < COUNT(k, i); j++)
+                {
+                    sum += SPEEDS(k, i)[j];
+                    sumsq += SPEEDS(k, i)[j] * SPEEDS(k, i)[j];
+                }
+                printf(" %6d %6.2lf%%", COUNT(k, i), 100 * ci_relative(COUNT(k, i), sum, sumsq));
+            }
+            printf("\n");
+        }
+    }
+#undef COUNT
+#undef SPEEDS
+    free(idletime);
+    free(speeds);
+}
+
+/* derived metrics of the counters: per worker over all its samples of
+ * each test, and over all workers */
+void perf_report(volatile double **mpcounters, volatile double **mpresults, int nr_procs, const int *sel, int nr_tests,
+                 int nr_loops, int nr_repeats, double mt)
+{
+    printf("\nPerformance counters ('-' if not available):\n");
+    printf("%-10s %6s %8s %6s %8s %9s %12s %13s\n", "", "worker", "GHz", "IPC", "B/cycle", "LLC miss%",
+           "LLC miss/KiB", "dTLB miss/KiB");
+    for (int k = 0; k < nr_tests; k++)
+    {
+        double kib = mt * nr_repeats * nr_loops * kernel_app_arrays(&kernels[sel[k]]) * 1024;
+        double sum[NR_PERF_EVENTS], time_sum = 0;
+        memset(sum, 0, sizeof(sum));
+        /* i == nr_procs + 1: the sum over all workers */
+        for (int i = 1; i <= nr_procs + 1 && (i <= nr_procs || nr_procs > 1); i++)
+        {
+            double c[NR_PERF_EVENTS], time, n = 1;
+            if (i <= nr_procs)
+            {
+                for (int e = 0; e < NR_PERF_EVENTS; e++)
+                {
+                    c[e] = mpcounters[i][k * NR_PERF_EVENTS + e];
+                    sum[e] += c[e];
+                }
+                time = mpresults[i][k] * nr_loops;
+                time_sum += time;
+            }
+            else
+            {
+                memcpy(c, sum, sizeof(c));
+                time = time_sum;
+                n = nr_procs;
+            }
+            printf("%-10s ", kernels[sel[k]].name);
+            if (i <= nr_procs)
+                printf("%6d", i);
+            else
+                printf("%6s", "all");
+#define PERF_COL(width, prec, cond, value)        \
+    if (cond)                                     \
+        printf(" %" #width "." #prec "lf", value); \
+    else                                          \
+        printf(" %" #width "s", "-");
+            PERF_COL(8, 3, !isnan(c[PERF_CYCLES]), c[PERF_CYCLES] / time * 1e-9);
+            PERF_COL(6, 2, !isnan(c[PERF_CYCLES] + c[PERF_INSTRUCTIONS]) && c[PERF_CYCLES],
+                     c[PERF_INSTRUCTIONS] / c[PERF_CYCLES]);
+            PERF_COL(8, 2, !isnan(c[PERF_CYCLES]) && c[PERF_CYCLES], kib * n * 1024 / c[PERF_CYCLES]);
+            PERF_COL(9, 1, !isnan(c[PERF_LLC_LOADS] + c[PERF_LLC_MISSES]) && c[PERF_LLC_LOADS],
+                     100 * c[PERF_LLC_MISSES] / c[PERF_LLC_LOADS]);
+            PERF_COL(12, 3, !isnan(c[PERF_LLC_MISSES]), c[PERF_LLC_MISSES] / (kib * n));
+            PERF_COL(13, 3, !isnan(c[PERF_DTLB_MISSES]), c[PERF_DTLB_MISSES] / (kib * n));
+#undef PERF_COL
+            printf("\n");
+        }
+    }
+}
+
+/* ------------------------------------------------------ */
+
+/* machine-readable results: every sample of the bandwidth tests with the
+ * configuration and the host, as JSON or CSV, and a check against the
+ * JSON of an earlier run */
+
+/* what the emitters need to know about the run */
+struct run_config
+{
+    unsigned long long array_bytes;
+    unsigned long long block_size;
+    int nr_repeats;
+    int nr_loops;
+    int nr_procs;
+    const int *cpus; /* [1..nr_procs] */
+    const int *sel;
+    int nr_tests;
+    int backend;
+    int src_node, dst_node;
+    int cold;
+    int sync;
+    double run_time;
+    volatile double **mpresults;
+    volatile int **mpcounts; /* NULL: nr_loops samples each */
+    double mt;
+};
+
+/* about the machine we ran on; "unknown" for what we can't find */
+struct host_info
+{
+    char hostname[256];
+    char cpu_model[256];
+    long cpus;
+    char kernel[512];
+    char thp[64];
+    char governor[64];
+};
+
+/* first line of a file without the newline
+ *
+ * return value: 0, -1 if it can't be read
+ */
+int read_line(const char *path, char *buf, int size)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return -1;
+    if (!fgets(buf, size, f))
+        buf[0] = '\0';
+    buf[strcspn(buf, "\n")] = '\0';
+    fclose(f);
+    return 0;
+}
+
+void host_info(struct host_info *h)
+{
+    struct utsname u;
+    char line[512];
+    FILE *f;
+
+    if (gethostname(h->hostname, sizeof(h->hostname)))
+        strcpy(h->hostname, "unknown");
+    strcpy(h->cpu_model, "unknown");
+    if ((f = fopen("/proc/cpuinfo", "r")))
+    {
+        while (fgets(line, sizeof(line), f))
+        {
+            char *colon = strchr(line, ':');
+            if (colon && (!strncmp(line, "model name", 10) || !strncmp(line, "Model", 5)))
+            {
+                snprintf(h->cpu_model, sizeof(h->cpu_model), "%s", colon + 2);
+                h->cpu_model[strcspn(h->cpu_model, "\n")] = '\0';
+                break;
+            }
+        }
+        fclose(f);
+    }
+    h->cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (uname(&u) == 0)
+        snprintf(h->kernel, sizeof(h->kernel), "%s %s %s", u.sysname, u.release, u.machine);
+    else
+        strcpy(h->kernel, "unknown");
+    /* "always [madvise] never": the one in brackets */
+    if (read_line("/sys/kernel/mm/transparent_hugepage/enabled", line, sizeof(line)) == 0 && strchr(line, '['))
+        snprintf(h->thp, sizeof(h->thp), "%.*s", (int)strcspn(strchr(line, '[') + 1, "]"), strchr(line, '[') + 1);
+    else
+        strcpy(h->thp, "unknown");
+    if (read_line("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor", h->governor, sizeof(h->governor)))
+        strcpy(h->governor, "unknown");
+}
+
+/* a JSON string literal */
+void json_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            fprintf(f, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(f, "\\u%04x", *s);
+        else
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+/* a JSON number with 'decimals' digits, null if it's inf or NaN (a zero
+ * or missing sample), which JSON has no literal for */
+void json_double(FILE *f, double v, int decimals)
+{
+    if (isfinite(v))
+        fprintf(f, "%.*lf", decimals, v);
+    else
+        fprintf(f, "null");
+}
+
+/* open an output file, "-" being stdout */
+FILE *open_output(const char *path)
+{
+    FILE *f = strcmp(path, "-") ? fopen(path, "w") : stdout;
+    if (!f)
+        printf("Error: can't write %s: %s\n", path, strerror(errno));
+    return f;
+}
+
+void close_output(FILE *f)
+{
+    if (f == stdout)
+        fflush(f);
+    else
+        fclose(f);
+}
+
+/* samples worker i took of test k */
+int run_samples(const struct run_config *rc, int i, int k)
+{
+    return rc->mpcounts ? rc->mpcounts[i][k] : rc->nr_loops;
+}
+
+/* app MiB/s of test k in total: the sum of the workers' means, as in
+ * the "Total speed" table */
+double run_total(const struct run_config *rc, int k)
+{
+    double app_mib = rc->mt * rc->nr_repeats * kernel_app_arrays(&kernels[rc->sel[k]]), sum = 0;
+    for (int i = 1; i <= rc->nr_procs; i++)
+    {
+        int n = run_samples(rc, i, k);
+        double speed_sum = 0;
+        for (int j = 1; j <= n; j++)
+            speed_sum += app_mib / rc->mpresults[i][j * rc->nr_tests + k];
+        sum += speed_sum / n;
+    }
+    return sum;
+}
+
+void write_json(const char *path, const struct run_config *rc, const struct host_info *h)
+{
+    FILE *f = open_output(path);
+    char date[64];
+    time_t now = time(NULL);
+
+    if (!f)
+        return;
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+    fprintf(f, "{\n  \"mbw\": \"%s\",\n  \"date\": \"%s\",\n", VERSION, date);
+    fprintf(f, "  \"host\": {\"hostname\": ");
+    json_string(f, h->hostname);
+    fprintf(f, ", \"cpu_model\": ");
+    json_string(f, h->cpu_model);
+    fprintf(f, ", \"cpus\": %ld, \"kernel\": ", h->cpus);
+    json_string(f, h->kernel);
+    fprintf(f, ", \"thp\": ");
+    json_string(f, h->thp);
+    fprintf(f, ", \"governor\": ");
+    json_string(f, h->governor);
+    fprintf(f, "},\n");
+    fprintf(f, "  \"config\": {\"array_bytes\": %llu, \"block_size\": %llu, \"repeats\": %d, \"loops\": %d, "
+               "\"workers\": %d, \"cpus\": [",
+            rc->array_bytes, rc->block_size, rc->nr_repeats, rc->nr_loops, rc->nr_procs);
+    for (int i = 1; i <= rc->nr_procs; i++)
+        fprintf(f, "%s%d", i > 1 ? ", " : "", rc->cpus[i]);
+    fprintf(f, "], \"tests\": [");
+    for (int k = 0; k < rc->nr_tests; k++)
+        fprintf(f, "%s\"%s\"", k ? ", " : "", kernels[rc->sel[k]].name);
+    fprintf(f, "], \"alloc\": \"%s%s\", \"src_node\": %d, \"dst_node\": %d, \"cold\": %d, \"sync\": %s, "
+               "\"timer\": \"%s\"},\n",
+            alloc_names[ALLOC_BACKEND(rc->backend)], rc->backend & ALLOC_POPULATE ? ",populate" : "", rc->src_node,
+            rc->dst_node, rc->cold, rc->sync ? "true" : "false", tsc_hz ? "tsc" : "clock_monotonic_raw");
+    fprintf(f, "  \"run_time\": ");
+    json_double(f, rc->run_time, 6);
+    fprintf(f, ",\n  \"results\": [\n");
+    for (int k = 0; k < rc->nr_tests; k++)
+    {
+        const struct kernel *kn = &kernels[rc->sel[k]];
+        double app_mib = rc->mt * rc->nr_repeats * kernel_app_arrays(kn);
+        double total = run_total(rc, k);
+        fprintf(f, "    {\"test\": \"%s\", \"app_mib_per_sample\": ", kn->name);
+        json_double(f, app_mib, 6);
+        fprintf(f, ", \"total_app_mibs\": ");
+        json_double(f, total, 3);
+        fprintf(f, ", \"total_bus_mibs\": ");
+        json_double(f, total * kernel_bus_arrays(kn) / kernel_app_arrays(kn), 3);
+        fprintf(f, ", \"workers\": [\n");
+        for (int i = 1; i <= rc->nr_procs; i++)
+        {
+            int n = run_samples(rc, i, k);
+            fprintf(f, "      {\"worker\": %d, \"cpu\": %d, \"mean_seconds\": ", i, rc->cpus[i]);
+            json_double(f, rc->mpresults[i][k], 9);
+            fprintf(f, ", \"seconds\": [");
+            for (int j = 1; j <= n; j++)
+            {
+                fprintf(f, "%s", j > 1 ? ", " : "");
+                json_double(f, rc->mpresults[i][j * rc->nr_tests + k], 9);
+            }
+            fprintf(f, "], \"app_mibs\": [");
+            for (int j = 1; j <= n; j++)
+            {
+                fprintf(f, "%s", j > 1 ? ", " : "");
+                json_double(f, app_mib / rc->mpresults[i][j * rc->nr_tests + k], 3);
+            }
+            fprintf(f, "]}%s\n", i < rc->nr_procs ? "," : "");
+        }
+        fprintf(f, "    ]}%s\n", k < rc->nr_tests - 1 ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    close_output(f);
+}
+
+/* one row per sample, the configuration and host in '#' lines on top */
+void write_csv(const char *path, const struct run_config *rc, const struct host_info *h)
+{
+    FILE *f = open_output(path);
+    if (!f)
+        return;
+    fprintf(f, "# mbw %s\n# host: %s\n# cpu_model: %s\n# cpus: %ld\n# kernel: %s\n# thp: %s\n# governor: %s\n",
+            VERSION, h->hostname, h->cpu_model, h->cpus, h->kernel, h->thp, h->governor);
+    fprintf(f, "# array_bytes: %llu\n# block_size: %llu\n# repeats: %d\n# loops: %d\n# workers: %d\n# alloc: %s%s\n",
+            rc->array_bytes, rc->block_size, rc->nr_repeats, rc->nr_loops, rc->nr_procs,
+            alloc_names[ALLOC_BACKEND(rc->backend)], rc->backend & ALLOC_POPULATE ? ",populate" : "");
+    fprintf(f, "test,worker,cpu,loop,seconds,app_mibs,bus_mibs\n");
+    for (int k = 0; k < rc->nr_tests; k++)
+    {
+        const struct kernel *kn = &kernels[rc->sel[k]];
+        double app_mib = rc->mt * rc->nr_repeats * kernel_app_arrays(kn);
+        double bus_mib = rc->mt * rc->nr_repeats * kernel_bus_arrays(kn);
+        for (int i = 1; i <= rc->nr_procs; i++)
+        {
+            for (int j = 1; j <= run_samples(rc, i, k); j++)
+            {
+                double te = rc->mpresults[i][j * rc->nr_tests + k];
+                fprintf(f, "%s,%d,%d,%d,%.9lf,%.3lf,%.3lf\n", kn->name, i, rc->cpus[i], j, te, app_mib / te,
+                        bus_mib / te);
+            }
+        }
+    }
+    close_output(f);
+}
+
+/* find "key": in s before 'end' and parse the number after it. This is
+ * no JSON parser: it only reads the fixed layout write_json() writes,
+ * where no string holds a key and the objects of interest don't nest
+ *
+ * return value: the number, NAN if not there or null
+ */
+double json_number(const char *s, const char *end, const char *key)
+{
+    char pattern[64];
+    const char *p;
+    char *num_end;
+    double v;
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    if (!(p = strstr(s, pattern)) || (end && p >= end))
+        return NAN;
+    v = strtod(p + strlen(pattern), &num_end);
+    return num_end == p + strlen(pattern) ? NAN : v;
+}
+
+/* compare the total app bandwidth of each test with a run saved by
+ * --json; a test slower by more than 'threshold' percent regressed
+ *
+ * return value: number of tests that regressed, -1 if the baseline
+ * can't be read
+ */
+int check_baseline(const char *path, const struct run_config *rc, double threshold)
+{
+    FILE *f = fopen(path, "r");
+    char *json;
+    long len;
+    int regressed = 0;
+
+    if (!f)
+    {
+        printf("Error: can't read the baseline %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (fseek(f, 0, SEEK_END) < 0 || (len = ftell(f)) < 0 || fseek(f, 0, SEEK_SET) < 0)
+    {
+        printf("Error: can't read the baseline %s: %s\n", path, strerror(errno));
+        fclose(f);
+        return -1;
+    }
+    json = malloc((size_t)len + 1);
+    if (!json)
+    {
+        printf("Error: can't allocate %ld bytes for the baseline %s\n", len, path);
+        fclose(f);
+        return -1;
+    }
+    len = fread(json, 1, len, f);
+    if (ferror(f))
+    {
+        printf("Error: can't read the baseline %s\n", path);
+        fclose(f);
+        free(json);
+        return -1;
+    }
+    json[len] = '\0';
+    fclose(f);
+
+    /* "config" and "results" of the baseline, each only searched for its own keys */
+    const char *config = strstr(json, "\"config\":"), *results = strstr(json, "\"results\":");
+    if (!config || !results)
+    {
+        printf("Error: %s is not a --json result file\n", path);
+        free(json);
+        return -1;
+    }
+    const char *config_end = strchr(config, '}');
+    double base_bytes = json_number(config, config_end, "array_bytes");
+    double base_workers = json_number(config, config_end, "workers");
+    if (base_bytes != rc->array_bytes || base_workers != rc->nr_procs)
+        printf("Warning: the baseline ran %.0lf bytes with %.0lf workers, this run %llu bytes with %d.\n",
+               base_bytes, base_workers, rc->array_bytes, rc->nr_procs);
+    printf("\nAgainst the baseline %s (total app MiB/s, regression beyond -%.1lf%%):\n", path, threshold);
+    printf("%-10s %12s %12s %8s\n", "", "baseline", "now", "change");
+    for (int k = 0; k < rc->nr_tests; k++)
+    {
+        const char *name = kernels[rc->sel[k]].name;
+        char pattern[64];
+        const char *p;
+        double now = run_total(rc, k), base;
+
+        /* the entry of this test in "results" */
+        snprintf(pattern, sizeof(pattern), "{\"test\": \"%s\"", name);
+        p = strstr(results, pattern);
+        if (!p || isnan(base = json_number(p, strstr(p, "\"workers\":"), "total_app_mibs")))
+        {
+            printf("%-10s %12s %12.2lf %8s\n", name, "-", now, "new");
+            continue;
+        }
+        /* nothing to compare a change with */
+        if (!(base > 0))
+        {
+            printf("%-10s %12.2lf %12.2lf %8s\n", name, base, now, "-");
+            continue;
+        }
+        double change = (now / base - 1) * 100;
+        printf("%-10s %12.2lf %12.2lf %+7.1lf%%", name, base, now, change);
+        if (change < -threshold)
+        {
+            printf("  REGRESSION");
+            regressed++;
+        }
+        printf("\n");
+    }
+    free(json);
+    return regressed;
+}
+
+/* ------------------------------------------------------ */
+
+/* sizes and working set sweeps */
+
+/* parse a size like 64, 4K, 1.5MiB or 2g; a bare number is counted in
+ * 'unit' bytes
+ *
+ * return value: size in bytes, 0 if malformed
+ */
+unsigned long long parse_size(const char *str, unsigned long long unit)
+{
+    char *end;
+    double v = strtod(str, &end);
+    if (end == str || v <= 0)
+        return 0;
+    switch (toupper(*end))
+    {
+    case '\0':
+        break;
+    case 'K':
+        unit = 1ULL << 10;
+        end++;
+        break;
+    case 'M':
+        unit = 1ULL << 20;
+        end++;
+        break;
+    case 'G':
+        unit = 1ULL << 30;
+        end++;
+        break;
+    case 'T':
+        unit = 1ULL << 40;
+        end++;
+        break;
+    case 'B':
+        unit = 1;
+        break;
+    default:
+        return 0;
+    }
+    if (*end && strcasecmp(end, "iB") && strcasecmp(end, "B"))
+        return 0;
+    return (unsigned long long)(v * unit);
+}
+
+/* human-readable size, e.g. 4K, 1.5M, 2G */
+char *format_size(char *buf, unsigned long long bytes)
+{
+    const char *units = "BKMGT";
+    double v = bytes;
+    while (v >= 1024 && units[1])
+    {
+        v /= 1024;
+        units++;
+    }
+    if (v == (unsigned long long)v)
+        sprintf(buf, "%llu%c", (unsigned long long)v, *units);
+    else
+        sprintf(buf, "%.1f%c", v, *units);
+    return buf;
+}
+
+/* fill 'sizes' from min up to and including max, multiplying by 'mult'
+ * or, if mult is 0, adding 'step' each time. Sizes are rounded down to
+ * multiples of 'gran' bytes.
+ *
+ * return value: number of sizes stored (at most MAX_SIZES)
+ */
+int make_sizes(unsigned long long *sizes, unsigned long long min, unsigned long long max,
+               double mult, unsigned long long step, unsigned int gran)
+{
+    int n = 0;
+    for (double sz = min; sz < max && n < MAX_SIZES - 1; sz = mult ? sz * mult : sz + step)
+        if (!n || (unsigned long long)sz / gran * gran > sizes[n - 1])
+            sizes[n++] = (unsigned long long)sz / gran * gran;
+    if (!n || max / gran * gran > sizes[n - 1])
+        sizes[n++] = max / gran * gran;
+    return n;
+}
+
+/* parse a sweep like 4K:1G:x2 (multiply) or 1M:64M:+1M (add); the step
+ * defaults to x2, sizes are multiples of 'gran' bytes
+ *
+ * return value: number of sizes stored in 'sizes', -1 if malformed
+ */
+int parse_sweep(unsigned long long *sizes, const char *spec, unsigned int gran)
+{
+    char buf[64];
+    char *min_str, *max_str, *step_str;
+    unsigned long long min, max, step = 0;
+    double mult = 2;
+
+    snprintf(buf, sizeof(buf), "%s", spec);
+    min_str = strtok(buf, ":");
+    max_str = strtok(NULL, ":");
+    step_str = strtok(NULL, ":");
+    if (!min_str || !max_str || strtok(NULL, ":"))
+        return -1;
+    min = parse_size(min_str, 1);
+    max = parse_size(max_str, 1);
+    if (min < gran || max < min)
+        return -1;
+    if (step_str && (*step_str == 'x' || *step_str == '*'))
+    {
+        mult = strtod(step_str + 1, NULL);
+        if (mult <= 1)
+            return -1;
+    }
+    else if (step_str && *step_str == '+')
+    {
+        mult = 0;
+        step = parse_size(step_str + 1, 1);
+        if (step < gran)
+            return -1;
+    }
+    else if (step_str)
+        return -1;
+    return make_sizes(sizes, min, max, mult, step, gran);
+}
+
+/* repeats for one sample of the sweep on 'bytes' out of 'max_bytes' */
+int sweep_repeats(unsigned long long bytes, unsigned long long max_bytes, int nr_repeats)
+{
+    return (int)((double)max_bytes / bytes * nr_repeats + 0.5);
+}
+
+/* worker side of the bandwidth sweep: every selected test on growing
+ * prefixes of the arrays. Smaller sizes get proportionally more repeats
+ * so every sample moves about as much data.
+ * Column s * nr_tests + k holds the time of test k on sizes[s].
+ */
+void sweep_worker(int procno, const struct kernel_args *full, const int *sel, int nr_tests,
+                  const unsigned long long *sizes, int nr_sizes, int nr_loops, int nr_repeats,
+                  int quiet, volatile double *results)
+{
+    char buf[32];
+    int nr_cols = nr_sizes * nr_tests;
+    for (int s = 0; s < nr_sizes; s++)
+    {
+        struct kernel_args ka = *full;
+        int repeats = sweep_repeats(sizes[s], sizes[nr_sizes - 1], nr_repeats);
+        ka.asize = sizes[s] / sizeof(long);
+        ka.array_bytes = sizes[s];
+        for (int k = 0; k < nr_tests; k++)
+        {
+            const struct kernel *kn = &kernels[sel[k]];
+            double te_sum = 0;
+            for (int i = 0; i < nr_loops; i++)
+            {
+                double te = worker(kn, &ka, repeats);
+                te_sum += te;
+                results[(i + 1) * nr_cols + s * nr_tests + k] = te;
+                if (!quiet)
+                {
+                    printf("worker %d\t%d\tSize: %s\t", procno, i, format_size(buf, sizes[s]));
+                    printout(te, (double)sizes[s] * repeats / 1024 / 1024, kn);
+                }
+            }
+            results[s * nr_tests + k] = te_sum / nr_loops;
+        }
+    }
+}
+
+/* controller side of the bandwidth sweep: one row per size, one column
+ * per test, app bandwidth summed over the workers */
+void sweep_report(volatile double **mpresults, int nr_procs, const int *sel, int nr_tests,
+                  const unsigned long long *sizes, int nr_sizes, int nr_repeats)
+{
+    char buf[32];
+    printf("\nApp bandwidth in MiB/s by working set size, all workers:\n");
+    printf("%8s", "size");
+    for (int k = 0; k < nr_tests; k++)
+        printf(" %11s", kernels[sel[k]].name);
+    printf("\n");
+    for (int s = 0; s < nr_sizes; s++)
+    {
+        int repeats = sweep_repeats(sizes[s], sizes[nr_sizes - 1], nr_repeats);
+        printf("%8s", format_size(buf, sizes[s]));
+        for (int k = 0; k < nr_tests; k++)
+        {
+            double mib = (double)sizes[s] * repeats / 1024 / 1024 * kernel_app_arrays(&kernels[sel[k]]);
+            double sum = 0;
+            for (int i = 1; i <= nr_procs; i++)
+                sum += mib / mpresults[i][s * nr_tests + k];
+            printf(" %11.2lf", sum);
+        }
+        printf("\n");
+    }
+}
+
+/* worker side of the -b sweep: mcblock with every block size
+ * Column s holds the time with block size sizes[s].
+ */
+void block_sweep_worker(int procno, const struct kernel_args *full, const unsigned long long *sizes, int nr_sizes,
+                        int nr_loops, int nr_repeats, double mt, int quiet, volatile double *results)
+{
+    const struct kernel *kn = &kernels[find_kernel("mcblock")];
+    char buf[32];
+    for (int s = 0; s < nr_sizes; s++)
+    {
+        struct kernel_args ka = *full;
+        double te_sum = 0;
+        ka.block_size = sizes[s];
+        for (int i = 0; i < nr_loops; i++)
+        {
+            double te = worker(kn, &ka, nr_repeats);
+            te_sum += te;
+            results[(i + 1) * nr_sizes + s] = te;
+            if (!quiet)
+            {
+                printf("worker %d\t%d\tBlock: %s\t", procno, i, format_size(buf, sizes[s]));
+                printout(te, mt * nr_repeats, kn);
+            }
+        }
+        results[s] = te_sum / nr_loops;
+    }
+}
+
+/* controller side of the -b sweep: total bandwidth by block size */
+void block_sweep_report(volatile double **mpresults, int nr_procs, const unsigned long long *sizes, int nr_sizes,
+                        int nr_repeats, double mt)
+{
+    const struct kernel *kn = &kernels[find_kernel("mcblock")];
+    double mib = mt * nr_repeats * kernel_app_arrays(kn), best = 0;
+    int best_s = 0;
+    char buf[32];
+    printf("\nApp bandwidth of mcblock in MiB/s by block size, all workers:\n");
+    printf("%8s %11s\n", "block", "mcblock");
+    for (int s = 0; s < nr_sizes; s++)
+    {
+        double sum = 0;
+        for (int i = 1; i <= nr_procs; i++)
+            sum += mib / mpresults[i][s];
+        if (sum > best)
+        {
+            best = sum;
+            best_s = s;
+        }
+        printf("%8s %11.2lf\n", format_size(buf, sizes[s]), sum);
+    }
+    printf("Best block size: %s\n", format_size(buf, sizes[best_s]));
+}
+
+/* worker side of the prefetch distance sweep: the selected tests
+ * without prefetches, then with every distance in 'dists'.
+ * Column d * nr_tests + k holds the time of test k with dists[d - 1],
+ * column k the time without prefetches.
+ */
+void prefetch_worker(int procno, struct kernel_args *ka, const unsigned long long *dists, int nr_dists, const int *sel,
+                     int nr_tests, int nr_loops, int nr_repeats, double mt, int quiet, volatile double *results)
+{
+    int nr_cols = (nr_dists + 1) * nr_tests;
+    for (int d = 0; d <= nr_dists; d++)
+    {
+        prefetch_distance = d ? (long)dists[d - 1] : -1;
+        for (int k = 0; k < nr_tests; k++)
+        {
+            const struct kernel *kn = &kernels[sel[k]];
+            double te_sum = 0;
+            for (int i = 0; i < nr_loops; i++)
+            {
+                double te = worker(kn, ka, nr_repeats);
+                te_sum += te;
+                results[(i + 1) * nr_cols + d * nr_tests + k] = te;
+                if (!quiet)
+                {
+                    printf("worker %d\t%d\tDistance: %ld\t", procno, i, prefetch_distance);
+                    printout(te, mt * nr_repeats, kn);
+                }
+            }
+            results[d * nr_tests + k] = te_sum / nr_loops;
+        }
+    }
+}
+
+/* controller side of the prefetch distance sweep: total bandwidth by
+ * distance, and the best distance of each test */
+void prefetch_report(volatile double **mpresults, int nr_procs, const unsigned long long *dists, int nr_dists,
+                     const int *sel, int nr_tests, int nr_repeats, double mt)
+{
+    double(*bw)[NR_KERNELS] = malloc(sizeof(*bw) * (nr_dists + 1));
+    char buf[32];
+    printf("\nApp bandwidth in MiB/s by prefetch distance (hint %s), all workers:\n", prefetch_hints[prefetch_hint]);
+    printf("%8s", "distance");
+    for (int k = 0; k < nr_tests; k++)
+        printf(" %11s", kernels[sel[k]].name);
+    printf("\n");
+    for (int d = 0; d <= nr_dists; d++)
+    {
+        printf("%8s", d ? format_size(buf, dists[d - 1]) : "none");
+        for (int k = 0; k < nr_tests; k++)
+        {
+            double mib = mt * nr_repeats * kernel_app_arrays(&kernels[sel[k]]);
+            bw[d][k] = 0;
+            for (int i = 1; i <= nr_procs; i++)
+                bw[d][k] += mib / mpresults[i][d * nr_tests + k];
+            printf(" %11.2lf", bw[d][k]);
+        }
+        printf("\n");
+    }
+    for (int k = 0; k < nr_tests; k++)
+    {
+        int best = 1;
+        for (int d = 2; d <= nr_dists; d++)
+            if (bw[d][k] > bw[best][k])
+                best = d;
+        printf("Best distance for %s: %s, %+.1lf%% vs no prefetch\n", kernels[sel[k]].name,
+               format_size(buf, dists[best - 1]), 100 * (bw[best][k] / bw[0][k] - 1));
+    }
+    free(bw);
+}
+
+/* ------------------------------------------------------ */
+
+/* src/dst offsets: where the arrays start relative to a page boundary,
+ * to see misalignment and 4K aliasing between source and destination */
+
+/* can the kernel run on arrays at any byte offset? The others use longs */
+int kernel_bytewise(const struct kernel *k)
+{
+    return k->copy || k->run == run_memcpy || k->run == run_mcblock;
+}
+
+/* parse a comma separated list of offsets in bytes
+ *
+ * return value: number of offsets stored in 'offsets', -1 if malformed
+ */
+int parse_offsets(long *offsets, int max, const char *str)
+{
+    int n = 0;
+    const char *p = str;
+    while (*p && n < max)
+    {
+        char *end;
+        long off = strtol(p, &end, 10);
+        if (end == p || off < 0 || (*end != ',' && *end != '\0'))
+            return -1;
+        offsets[n++] = off;
+        p = *end ? end + 1 : end;
+    }
+    return *p ? -1 : n;
+}
+
+/* longs to allocate beyond the array so it can start 'max_offset'
+ * bytes past the first page boundary */
+unsigned long long offset_pad(long max_offset)
+{
+    return (OFFSET_ALIGN + max_offset) / sizeof(long) + 1;
+}
+
+/* the array starting 'offset' bytes past the first page boundary of an
+ * allocation padded with offset_pad() */
+long *offset_array(long *base, long offset)
+{
+    if (!base)
+        return NULL;
+    return (long *)(((uintptr_t)base + OFFSET_ALIGN - 1) / OFFSET_ALIGN * OFFSET_ALIGN + offset);
+}
+
+/* worker side of the offset sweep: every selected test with every pair
+ * of source and destination offsets. bases holds the padded a, b, c.
+ * Column (s * nr_offsets + d) * nr_tests + k holds the time of test k
+ * with the source at offsets[s] and the destinations at offsets[d].
+ */
+void offset_worker(int procno, const struct kernel_args *full, long **bases, const long *offsets, int nr_offsets,
+                   const int *sel, int nr_tests, int nr_loops, int nr_repeats, double mt, int quiet,
+                   volatile double *results)
+{
+    int nr_cols = nr_offsets * nr_offsets * nr_tests;
+    for (int s = 0; s < nr_offsets; s++)
+    {
+        for (int d = 0; d < nr_offsets; d++)
+        {
+            struct kernel_args ka = *full;
+            int col = (s * nr_offsets + d) * nr_tests;
+            ka.a = offset_array(bases[0], offsets[s]);
+            ka.b = offset_array(bases[1], offsets[d]);
+            ka.c = offset_array(bases[2], offsets[d]);
+            for (int k = 0; k < nr_tests; k++)
+            {
+                const struct kernel *kn = &kernels[sel[k]];
+                double te_sum = 0;
+                for (int i = 0; i < nr_loops; i++)
+                {
+                    double te = worker(kn, &ka, nr_repeats);
+                    te_sum += te;
+                    results[(i + 1) * nr_cols + col + k] = te;
+                    if (!quiet)
+                    {
+                        printf("worker %d\t%d\tsrc+%ld dst+%ld\t", procno, i, offsets[s], offsets[d]);
+                        printout(te, mt * nr_repeats, kn);
+                    }
+                }
+                results[col + k] = te_sum / nr_loops;
+            }
+        }
+    }
+}
+
+/* controller side of the offset sweep: one src x dst grid per test,
+ * and its worst cell compared to the first */
+void offset_report(volatile double **mpresults, int nr_procs, const long *offsets, int nr_offsets, const int *sel,
+                   int nr_tests, int nr_repeats, double mt)
+{
+    double *grid = malloc(sizeof(double) * nr_offsets * nr_offsets);
+    for (int k = 0; k < nr_tests; k++)
+    {
+        double mib = mt * nr_repeats * kernel_app_arrays(&kernels[sel[k]]);
+        int worst = 0;
+        for (int c = 0; c < nr_offsets * nr_offsets; c++)
+        {
+            grid[c] = 0;
+            for (int i = 1; i <= nr_procs; i++)
+                grid[c] += mib / mpresults[i][c * nr_tests + k];
+            if (grid[c] < grid[worst])
+                worst = c;
+        }
+        printf("\nApp bandwidth of %s in MiB/s by offset from a page boundary, all workers\n", kernels[sel[k]].name);
+        printf("(rows: source, columns: destination):\n");
+        printf("%8s", "");
+        for (int d = 0; d < nr_offsets; d++)
+            printf(" %10ld", offsets[d]);
+        printf("\n");
+        for (int s = 0; s < nr_offsets; s++)
+        {
+            printf("%8ld", offsets[s]);
+            for (int d = 0; d < nr_offsets; d++)
+                printf(" %10.2lf", grid[s * nr_offsets + d]);
+            printf("\n");
+        }
+        printf("Worst: src+%ld dst+%ld, %.1lf%% of src+%ld dst+%ld\n", offsets[worst / nr_offsets],
+               offsets[worst % nr_offsets], 100 * grid[worst] / grid[0], offsets[0], offsets[0]);
+    }
+    free(grid);
+}
+
+/* ------------------------------------------------------ */
+
+/* pointer-chasing latency test */
+
+/* the chase stores where it ended here so it can't be optimized away */
+void *volatile chase_sink;
+
+/* small, fast and reproducible; seeded with the worker number */
+unsigned int xorshift32(unsigned int *state)
+{
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/* fill the index array of gather and scatter: every element of an
+ * n long array once, in the --index order */
+void build_index(unsigned int *idx, unsigned long long n, unsigned int seed)
+{
+    unsigned long long k = 0, step = access_stride / sizeof(long);
+    if (index_pattern == INDEX_STRIDE)
+    {
+        for (unsigned long long col = 0; col < step; col++)
+            for (unsigned long long t = col; t < n; t += step)
+                idx[k++] = t;
+        return;
+    }
+    for (unsigned long long t = 0; t < n; t++)
+        idx[t] = t;
+    if (index_pattern == INDEX_RANDOM)
+    {
+        /* Fisher-Yates */
+        for (unsigned long long t = n - 1; t > 0; t--)
+        {
+            unsigned long long j = xorshift32(&seed) % (t + 1);
+            unsigned int tmp = idx[t];
+            idx[t] = idx[j];
+            idx[j] = tmp;
+        }
+    }
+}
+
+/* link the first 'bytes' of 'base' into a single random cycle with one
+ * pointer every 'stride' bytes. With page stride the pointer sits on a
+ * random cache line of its page, so the pages don't all fight for the
+ * same cache set.
+ *
+ * return value: start of the chain, NULL if out of memory
+ */
+void *build_chase(char *base, unsigned long long bytes, unsigned int stride, unsigned int seed)
+{
+    unsigned long long n = bytes / stride;
+    unsigned int *next = malloc(sizeof(*next) * n);
+    unsigned int *off = malloc(sizeof(*off) * n);
+    unsigned int state = seed ? seed : 1;
+
+    if (!next || !off || n < 1)
+    {
+        free(next);
+        free(off);
+        return NULL;
+    }
+    /* Sattolo's shuffle gives a permutation that is a single cycle */
+    for (unsigned long long i = 0; i < n; i++)
+        next[i] = i;
+    for (unsigned long long i = n - 1; i > 0; i--)
+    {
+        unsigned long long j = xorshift32(&state) % i;
+        unsigned int t = next[i];
+        next[i] = next[j];
+        next[j] = t;
+    }
+    for (unsigned long long i = 0; i < n; i++)
+        off[i] = stride > LATENCY_LINE ? xorshift32(&state) % (stride / LATENCY_LINE) * LATENCY_LINE : 0;
+    for (unsigned long long i = 0; i < n; i++)
+        *(void **)(base + i * stride + off[i]) = base + (unsigned long long)next[i] * stride + off[next[i]];
+
+    void *start = base + off[0];
+    free(next);
+    free(off);
+    return start;
+}
+
+/* follow the chain for 'loads' steps
+ *
+ * return value: elapsed time in seconds
+ */
+double chase(void *start, unsigned long long loads)
+{
+    double starttime, endtime;
+    void **p = start;
+
+    starttime = timestamp();
+    for (unsigned long long t = loads / 8; t; t--)
+    {
+        p = *p;
+        p = *p;
+        p = *p;
+        p = *p;
+        p = *p;
+        p = *p;
+        p = *p;
+        p = *p;
+    }
+    endtime = timestamp();
+    chase_sink = p;
+
+    return endtime - starttime;
+}
+
+/* how many loads one latency sample does on a working set */
+unsigned long long latency_loads(unsigned long long bytes, unsigned int stride, int repeats)
+{
+    unsigned long long n = bytes / stride;
+    return (n > LATENCY_MIN_LOADS ? n : LATENCY_MIN_LOADS) * repeats;
+}
+
+/* worker side of the latency test: one column per working set size,
+ * values are nanoseconds per load
+ */
+void latency_worker(int procno, long *a, unsigned long long *sizes, int nr_sizes, unsigned int stride,
+                    int nr_loops, int nr_repeats, int quiet, int showavg, volatile double *results)
+{
+    char buf[32];
+    for (int s = 0; s < nr_sizes; s++)
+    {
+        void *start = build_chase((char *)a, sizes[s], stride, procno * 2654435761u);
+        unsigned long long loads = latency_loads(sizes[s], stride, nr_repeats);
+        double ns_sum = 0;
+        if (!start)
+        {
+            printf("worker %d: failed to build a chain of %llu bytes\n", procno, sizes[s]);
+            exit(1);
+        }
+        /* one untimed walk to warm up caches and TLB */
+        chase(start, loads);
+        for (int i = 0; nr_loops == 0 || i < nr_loops; i++)
+        {
+            double ns = chase(start, loads) * 1e9 / loads;
+            ns_sum += ns;
+            if (!quiet)
+                printf("worker %d\t%d\tSize: %s\tLatency: %.3f ns\n", procno, i, format_size(buf, sizes[s]), ns);
+            if (nr_loops)
+                results[(i + 1) * nr_sizes + s] = ns;
+        }
+        if (showavg && !quiet)
+            printf("worker %d\tAVG\tSize: %s\tLatency: %.3f ns\n", procno, format_size(buf, sizes[s]), ns_sum / nr_loops);
+        results[s] = ns_sum / nr_loops;
+    }
+}
+
+/* controller side of the latency test */
+void latency_report(volatile double **mpresults, int nr_procs, unsigned long long *sizes, int nr_sizes, int nr_loops,
+                    int histogram)
+{
+    char buf[32];
+    double *all = malloc(sizeof(double) * nr_procs * nr_loops);
+    for (int i = 1; i <= nr_procs; i++)
+    {
+        printf("Worker #%d\n", i);
+        for (int s = 0; s < nr_sizes; s++)
+        {
+            printf("%8s\t", format_size(buf, sizes[s]));
+            for (int j = 0; j <= nr_loops; j++)
+                printf("%8.3lf\t", mpresults[i][j * nr_sizes + s]);
+            printf("\n");
+        }
+    }
+
+    printf("\nLatency in ns per load, per worker and average | statistics over all samples:\n");
+    printf("%8s", "size");
+    for (int i = 1; i <= nr_procs; i++)
+        printf(" %7s%d", "#", i);
+    printf(" | %8s | %8s %8s %8s %8s %8s %6s\n", "avg", "min", "median", "p90", "p99", "max", "cv%");
+    for (int s = 0; s < nr_sizes; s++)
+    {
+        struct stats st;
+        double sum = 0;
+        printf("%8s", format_size(buf, sizes[s]));
+        for (int i = 1; i <= nr_procs; i++)
+        {
+            printf(" %8.3lf", mpresults[i][s]);
+            sum += mpresults[i][s];
+            for (int j = 1; j <= nr_loops; j++)
+                all[(i - 1) * nr_loops + j - 1] = mpresults[i][j * nr_sizes + s];
+        }
+        compute_stats(&st, all, nr_procs * nr_loops);
+        printf(" | %8.3lf | %8.3lf %8.3lf %8.3lf %8.3lf %8.3lf %6.2lf\n", sum / nr_procs,
+               st.min, st.median, st.p90, st.p99, st.max, st.cv * 100);
+        if (histogram)
+            print_histogram(all, nr_procs * nr_loops, HISTOGRAM_BINS, "ns");
+    }
+    free(all);
+}
+
+int parse_cpu_affinity_str(int *cpu_pinno, const char *cpu_pinstr)
+{
+    int *pcpu_pinno = cpu_pinno;
+    const char *p = cpu_pinstr;
+    int start = -1, end = -1, step = -1;
+    while (*p)
+    {
+        int t = 0;
+        while (isdigit(*p))
+        {
+            t = t * 10 + (*p - '0');
+            p++;
+        }
+        if (*p == ':' || *p == ',' || *p == '\0')
+        {
+            if (start == -1)
+            {
+                start = t;
+            }
+            else if (end == -1)
+            {
+                end = t;
+            }
+            else if (step == -1)
+            {
+                step = end;
+                end = t;
+            }
+            else
+                return -1;
+            if (*p != ':')
+            {
+                if (end == -1) /* a single cpu */
+                    end = start;
+                for (int i = start; i <= end; i += (step >= 1 ? step : 1))
+                    *(++pcpu_pinno) = i;
+                start = end = step = -1;
+            }
+            if (!*p)
+                break;
+            p++;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+    return pcpu_pinno - cpu_pinno;
+}
+
+/* ------------------------------------------------------ */
+
+/* controller/worker handshake
+ *
+ * Every worker has its own slot, on its own cache line, so neither the
+ * handshake nor a worker polling for "stop" shares a line with another
+ * worker. Waiters spin for a little while and then sleep on a futex,
+ * so idle cores neither burn CPU nor generate coherence traffic.
+ */
+
+/* worker states; the workers set the odd ones from ST_PINNED to ST_DONE,
+ * the controller the even ones from ST_PING to ST_STOP and ST_EXIT.
+ * ST_FORKED is the initial value, and either side sets ST_ABORT when
+ * it fails: a worker that can't start, or the controller to end them */
+#define ST_ABORT -1 /* either: something failed, exit */
+#define ST_FORKED 0 /* worker: starting up */
+#define ST_PINNED 1 /* worker: pinned, waiting for the ping */
+#define ST_PING 2   /* controller: respond */
+#define ST_PONG 3   /* worker: responded */
+#define ST_ALLOC 4  /* controller: allocate the arrays */
+#define ST_READY 5  /* worker: arrays allocated */
+#define ST_RUN 6    /* controller: run the tests (or the next level, configuration) */
+#define ST_DONE 7   /* worker: finished */
+#define ST_STOP 8   /* controller: hogs, stop */
+#define ST_EXIT 9   /* controller: worker can exit */
+
+/* how long to spin before going to sleep on the futex */
+#define SPIN_WAIT_LOOPS 20000
+
+#ifdef HAVE_X86
+#define cpu_relax() _mm_pause()
+#else
+#define cpu_relax() __asm__ volatile("" ::: "memory")
+#endif
+
+struct slot
+{
+    int state;         /* futex word */
+    double released;   /* when the worker last saw its state change */
+    double alloc_time; /* how long the worker took to allocate its arrays */
+} __attribute__((aligned(64)));
+
+/* the slots are shared between processes, so no FUTEX_PRIVATE_FLAG */
+static long futex(int *uaddr, int op, int val)
+{
+    return syscall(SYS_futex, uaddr, op, val, NULL, NULL, 0);
+}
+
+int state_get(struct slot *s)
+{
+    return __atomic_load_n(&s->state, __ATOMIC_ACQUIRE);
+}
+
+/* store to a futex word and wake whoever waits on it */
+void futex_store(int *word, int value)
+{
+    __atomic_store_n(word, value, __ATOMIC_RELEASE);
+    futex(word, FUTEX_WAKE, INT_MAX);
+}
+
+void state_set(struct slot *s, int state)
+{
+    futex_store(&s->state, state);
+}
+
+/* wait until the word leaves 'value', spinning first
+ *
+ * return value: the new value
+ */
+int futex_wait_while(int *word, int value)
+{
+    int cur;
+    for (int i = 0; i < SPIN_WAIT_LOOPS; i++)
+    {
+        cur = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+        if (cur != value)
+            return cur;
+        cpu_relax();
+    }
+    while ((cur = __atomic_load_n(word, __ATOMIC_ACQUIRE)) == value)
+        futex(word, FUTEX_WAIT, value);
+    return cur;
+}
+
+/* controller side: wait for the worker to leave 'state' */
+int state_wait(struct slot *s, int state)
+{
+    return futex_wait_while(&s->state, state);
+}
+
+/* worker side: wait for the controller to leave 'state', note when,
+ * and exit if told to
+ *
+ * return value: the new state
+ */
+int worker_wait(struct slot *s, int state)
+{
+    int cur = futex_wait_while(&s->state, state);
+    s->released = timestamp();
+    if (cur == ST_ABORT || cur == ST_EXIT)
+        exit(cur == ST_ABORT);
+    return cur;
+}
+
+/* tell every worker to give up */
+void abort_workers(struct slot *procmap, int nr_procs)
+{
+    for (int i = 1; i <= nr_procs; i++)
+        state_set(&procmap[i], ST_ABORT);
+}
+
+/* print how far apart the workers were released after 'since' */
+void print_release_skew(struct slot *procmap, int nr_procs, double since)
+{
+    double first = procmap[1].released, last = first;
+    printf("Release delay per worker (us):");
+    for (int i = 1; i <= nr_procs; i++)
+    {
+        double r = procmap[i].released;
+        printf(" %.1lf", (r - since) * 1e6);
+        first = r < first ? r : first;
+        last = r > last ? r : last;
+    }
+    printf("\nStart skew between workers: %.1lf us.\n", (last - first) * 1e6);
+}
+
+/* ------------------------------------------------------ */
+
+/* loaded latency: hog workers generate traffic at a given injection
+ * rate while probe workers chase pointers
+ *
+ * The controller drives the workers level by level: ST_RUN runs the
+ * level, ST_STOP stops the hogs, the workers answer ST_DONE.
+ */
+
+struct loaded_config
+{
+    int *is_probe;       /* per worker (1-based): probe or hog */
+    long *delays;        /* per level: delay after each hog chunk in ns, -1 for idle hogs */
+    int nr_levels;
+    const struct kernel *hog;  /* what the hogs run */
+    unsigned long long chunk_bytes; /* hogs run the kernel on chunks of this size */
+    unsigned int stride;  /* probe chain granularity */
+};
+
+/* busy-wait, sleeping would give up the core and miss the target rate */
+void spin_ns(long ns)
+{
+    double end = timestamp() + ns * 1e-9;
+    while (timestamp() < end)
+        ;
+}
+
+/* parse the --delays list
+ *
+ * return value: number of levels stored in 'delays' including the idle
+ * level, -1 on a malformed list
+ */
+int parse_delays(long *delays, int max, const char *str)
+{
+    int n = 0;
+    const char *p = str;
+    delays[n++] = -1;
+    while (*p && n < max)
+    {
+        char *end;
+        long d = strtol(p, &end, 10);
+        if (end == p || d < 0 || (*end != ',' && *end != '\0'))
+            return -1;
+        delays[n++] = d;
+        p = *end ? end + 1 : end;
+    }
+    return n;
+}
+
+/* worker side of the loaded latency test
+ * probes store ns per load per level (row 0: average, rows 1..nr_loops: samples),
+ * hogs store their app bandwidth in MiB/s per level in row 0
+ */
+void loaded_worker(int procno, struct slot *slot, const struct loaded_config *lc,
+                   long *a, long *b, long *c, unsigned long long asize,
+                   int nr_loops, int nr_repeats, int quiet, volatile double *results)
+{
+    unsigned long long array_bytes = asize * sizeof(long);
+    int nr_cols = lc->nr_levels;
+
+    if (lc->is_probe[procno])
+    {
+        void *start = build_chase((char *)a, array_bytes, lc->stride, procno * 2654435761u);
+        unsigned long long loads = latency_loads(array_bytes, lc->stride, nr_repeats);
+        if (!start)
+        {
+            printf("worker %d: failed to build a chain of %llu bytes\n", procno, array_bytes);
+            exit(1);
+        }
+        chase(start, loads);
+        for (int l = 0; l < lc->nr_levels; l++)
+        {
+            double ns_sum = 0;
+            for (int i = 0; i < nr_loops; i++)
+            {
+                double ns = chase(start, loads) * 1e9 / loads;
+                ns_sum += ns;
+                results[(i + 1) * nr_cols + l] = ns;
+            }
+            results[l] = ns_sum / nr_loops;
+            if (!quiet)
+                printf("worker %d\tprobe\tDelay: %ld\tLatency: %.3f ns\n", procno, lc->delays[l], results[l]);
+            state_set(slot, ST_DONE);
+            worker_wait(slot, ST_DONE);
+        }
+    }
+    else
+    {
+        unsigned long long chunk = lc->chunk_bytes / sizeof(long);
+        unsigned long long nr_chunks = asize / chunk;
+        for (int l = 0; l < lc->nr_levels; l++)
+        {
+            double starttime, endtime;
+            unsigned long long done = 0;
+            starttime = timestamp();
+            if (lc->delays[l] < 0)
+            {
+                worker_wait(slot, ST_RUN);
+            }
+            else
+            {
+                for (unsigned long long t = 0; state_get(slot) == ST_RUN; t = (t + 1) % nr_chunks, done++)
+                {
+                    struct kernel_args ka = {
+                        .a = a + t * chunk,
+                        .b = b ? b + t * chunk : NULL,
+                        .c = c ? c + t * chunk : NULL,
+                        .asize = chunk,
+                        .array_bytes = lc->chunk_bytes,
+                        .block_size = lc->chunk_bytes,
+                        .rep = l,
+                    };
+                    if (lc->hog->copy)
+                        lc->hog->copy(ka.b, ka.a, ka.array_bytes);
+                    else
+                        lc->hog->run(&ka);
+                    if (lc->delays[l])
+                        spin_ns(lc->delays[l]);
+                }
+            }
+            endtime = timestamp();
+            results[l] = done * lc->chunk_bytes * kernel_app_arrays(lc->hog) / 1024 / 1024 / (endtime - starttime);
+            if (!quiet)
+                printf("worker %d\thog\tDelay: %ld\tApp: %.3f MiB/s\n", procno, lc->delays[l], results[l]);
+            state_set(slot, ST_DONE);
+            worker_wait(slot, ST_DONE);
+        }
+    }
+    exit(0);
+}
+
+/* controller side of the loaded latency test: run every level and print
+ * the loaded-latency curve
+ */
+void loaded_controller(struct slot *procmap, volatile double **mpresults, const struct loaded_config *lc, int nr_procs)
+{
+    int nr_probes = 0;
+    for (int i = 1; i <= nr_procs; i++)
+        nr_probes += lc->is_probe[i];
+
+    printf("\nLoaded latency (%d probes, %d hogs running %s in %llu byte chunks):\n",
+           nr_probes, nr_procs - nr_probes, lc->hog->name, lc->chunk_bytes);
+    printf("%10s %12s %12s |", "delay(ns)", "hog MiB/s", "latency(ns)");
+    for (int i = 1; i <= nr_procs; i++)
+        printf(" %9s%d", lc->is_probe[i] ? "probe#" : "hog#", i);
+    printf("\n");
+    for (int l = 0; l < lc->nr_levels; l++)
+    {
+        double bw = 0, lat = 0;
+
+        for (int i = 1; i <= nr_procs; i++)
+            if (!lc->is_probe[i])
+                state_set(&procmap[i], ST_RUN);
+        if (lc->delays[l] >= 0)
+            usleep(LOADED_WARMUP_US);
+        for (int i = 1; i <= nr_procs; i++)
+            if (lc->is_probe[i])
+                state_set(&procmap[i], ST_RUN);
+        for (int i = 1; i <= nr_procs; i++)
+            if (lc->is_probe[i])
+                state_wait(&procmap[i], ST_RUN);
+        for (int i = 1; i <= nr_procs; i++)
+            if (!lc->is_probe[i])
+            {
+                state_set(&procmap[i], ST_STOP);
+                state_wait(&procmap[i], ST_STOP);
+            }
+
+        for (int i = 1; i <= nr_procs; i++)
+        {
+            if (lc->is_probe[i])
+                lat += mpresults[i][l];
+            else
+                bw += mpresults[i][l];
+        }
+        if (lc->delays[l] < 0)
+            printf("%10s", "idle");
+        else
+            printf("%10ld", lc->delays[l]);
+        printf(" %12.2lf %12.3lf |", bw, lat / nr_probes);
+        for (int i = 1; i <= nr_procs; i++)
+            printf(" %10.3lf", mpresults[i][l]);
+        printf("\n");
+    }
+    for (int i = 1; i <= nr_procs; i++)
+        state_set(&procmap[i], ST_EXIT);
+}
+
+/* ------------------------------------------------------ */
+
+/* scaling sweep: one pool of pinned workers, run the tests on growing
+ * subsets of it. Idle workers keep their arrays and wait in ST_DONE. */
+
+/* worker counts and pool strides to try, the same set mbw-gen used to
+ * generate scripts for: for every divisor d of the pool size, pool/d
+ * workers with each stride up to d (powers of two only for the larger
+ * divisors), and stride 1 for all other counts. Sorted by worker count,
+ * then stride, so the single worker baseline comes first.
+ *
+ * return value: number of configurations stored in 'configs'
+ */
+int scaling_configs(int (*configs)[2], int pool)
+{
+    char *seen = calloc(pool + 1, 1);
+    int n = 0, im;
+
+    for (im = 1; im * im <= pool; im++)
+    {
+        if (pool % im)
+            continue;
+        for (int j = 1; j <= im; j++)
+        {
+            configs[n][0] = pool / im;
+            configs[n++][1] = j;
+        }
+        seen[pool / im] = 1;
+    }
+    for (; im < pool; im++)
+    {
+        if (pool % im)
+            continue;
+        for (int j = 1; j <= im; j *= 2)
+        {
+            configs[n][0] = pool / im;
+            configs[n++][1] = j;
+        }
+        seen[pool / im] = 1;
+    }
+    for (int i = pool; i >= 1; i--)
+    {
+        if (seen[i])
+            continue;
+        configs[n][0] = i;
+        configs[n++][1] = 1;
+    }
+    free(seen);
+
+    /* insertion sort, there are only a few */
+    for (int i = 1; i < n; i++)
+        for (int j = i; j > 0 && (configs[j - 1][0] > configs[j][0] ||
+                                  (configs[j - 1][0] == configs[j][0] && configs[j - 1][1] > configs[j][1]));
+             j--)
+        {
+            int t0 = configs[j][0], t1 = configs[j][1];
+            configs[j][0] = configs[j - 1][0];
+            configs[j][1] = configs[j - 1][1];
+            configs[j - 1][0] = t0;
+            configs[j - 1][1] = t1;
+        }
+    return n;
+}
+
+/* worker side: run the tests every time the controller says ST_RUN */
+void scaling_worker(int procno, struct slot *slot, struct kernel_args *ka, const int *sel, int nr_tests,
+                    int nr_loops, int nr_repeats, double mt, volatile double *results)
+{
+    for (;;)
+    {
+        bandwidth_worker(procno, ka, sel, nr_tests, nr_loops, nr_repeats, mt, 1, 0, results, NULL, NULL);
+        state_set(slot, ST_DONE);
+        worker_wait(slot, ST_DONE);
+    }
+}
+
+/* controller side: step through the configurations and print one
+ * scaling table per test */
+void scaling_controller(struct slot *procmap, volatile double **mpresults, int nr_procs, const int *cpu_pinno,
+                        const int *sel, int nr_tests, int nr_repeats, double mt, int quiet)
+{
+    int(*configs)[2] = malloc(sizeof(*configs) * nr_procs * (nr_procs + 1));
+    int nr_configs = scaling_configs(configs, nr_procs);
+    /* aggregate app bandwidth per configuration and test */
+    double(*total)[NR_KERNELS] = malloc(sizeof(*total) * nr_configs);
+
+    for (int c = 0; c < nr_configs; c++)
+    {
+        int n = configs[c][0], stride = configs[c][1];
+        double starttime, endtime;
+
+        starttime = timestamp();
+        for (int t = 0; t < n; t++)
+            state_set(&procmap[1 + t * stride], ST_RUN);
+        for (int t = 0; t < n; t++)
+            state_wait(&procmap[1 + t * stride], ST_RUN);
+        endtime = timestamp();
+
+        for (int k = 0; k < nr_tests; k++)
+        {
+            double app_mib = mt * nr_repeats * kernel_app_arrays(&kernels[sel[k]]);
+            total[c][k] = 0;
+            for (int t = 0; t < n; t++)
+                total[c][k] += app_mib / mpresults[1 + t * stride][k];
+        }
+        if (!quiet)
+        {
+            printf("%d workers, stride %d: %.3lf seconds\n", n, stride, endtime - starttime);
+            fflush(stdout);
+        }
+    }
+    for (int i = 1; i <= nr_procs; i++)
+        state_set(&procmap[i], ST_EXIT);
+
+    for (int k = 0; k < nr_tests; k++)
+    {
+        /* the first configuration is the single worker */
+        double single = total[0][k];
+        printf("\nScaling of %s (app MiB/s):\n", kernels[sel[k]].name);
+        printf("%8s %6s %12s %12s %10s  %s\n", "workers", "stride", "total", "per-worker", "efficiency", "cpus");
+        for (int c = 0; c < nr_configs; c++)
+        {
+            int n = configs[c][0], stride = configs[c][1];
+            printf("%8d %6d %12.2lf %12.2lf %9.1lf%%  ", n, stride, total[c][k], total[c][k] / n,
+                   100 * total[c][k] / n / single);
+            for (int t = 0; t < n; t++)
+                printf("%s%d", t ? "," : "", cpu_pinno[1 + t * stride]);
+            printf("\n");
+        }
+    }
+    free(total);
+    free(configs);
+}
+
+/* ------------------------------------------------------ */
+
+/* lock-step mode: all workers start every test iteration together so
+ * their bandwidth actually overlaps in time */
+
+/* sense-reversing barrier shared by the forked workers; sense is also
+ * the futex word the waiters sleep on */
+struct barrier
+{
+    int count;
+    int sense;
+    int nr_procs;
+} __attribute__((aligned(64)));
+
+/* each worker flips its own sense on every barrier it passes */
+void barrier_wait(struct barrier *bar, int *local_sense)
+{
+    *local_sense = !*local_sense;
+    if (__atomic_add_fetch(&bar->count, 1, __ATOMIC_ACQ_REL) == bar->nr_procs)
+    {
+        bar->count = 0;
+        __atomic_store_n(&bar->sense, *local_sense, __ATOMIC_RELEASE);
+        futex(&bar->sense, FUTEX_WAKE, INT_MAX);
+    }
+    else
+        futex_wait_while(&bar->sense, !*local_sense);
+}
+
+/* like bandwidth_worker(), but every iteration starts at a barrier.
+ * stamps: start and end time of each iteration, at
+ * [(i * nr_tests + k) * 2] and [... + 1]
+ */
+void sync_worker(int procno, struct kernel_args *ka, const int *sel, int nr_tests, int nr_loops, int nr_repeats,
+                 double mt, int quiet, struct barrier *bar, volatile double *results, volatile double *stamps,
+                 struct perf_counters *pc)
+{
+    int sense = 0;
+    for (int k = 0; k < nr_tests; k++)
+    {
+        const struct kernel *kn = &kernels[sel[k]];
+        double te_sum = 0;
+        for (int i = 0; i < nr_loops; i++)
+        {
+            barrier_wait(bar, &sense);
+            if (pc)
+                perf_start(pc->fds, NR_PERF_EVENTS);
+            double t0 = timestamp();
+            double te = worker(kn, ka, nr_repeats);
+            double t1 = timestamp();
+            if (pc)
+                perf_stop(pc->fds, NR_PERF_EVENTS, pc->counts + k * NR_PERF_EVENTS);
+            stamps[(i * nr_tests + k) * 2] = t0;
+            stamps[(i * nr_tests + k) * 2 + 1] = t1;
+            te_sum += te;
+            results[(i + 1) * nr_tests + k] = te;
+            if (!quiet)
+            {
+                printf("worker %d\t%d\t", procno, i);
+                printout(te, mt * nr_repeats, kn);
+            }
+        }
+        results[k] = te_sum / nr_loops;
+    }
+}
+
+/* controller side: aggregate bandwidth of each iteration is all the
+ * workers' bytes over the wall-clock window from the first start to the
+ * last finish */
+void sync_report(volatile double **mpstamps, int nr_procs, const int *sel, int nr_tests, int nr_loops,
+                 int nr_repeats, double mt)
+{
+    printf("\nLock-step aggregate (app MiB/s over the wall-clock window of each iteration):\n");
+    printf("%-10s %10s %10s %10s %10s | %21s | %21s\n", "", "aggregate", "min", "max", "bus",
+           "start skew avg/max us", "finish skew avg/max us");
+    for (int k = 0; k < nr_tests; k++)
+    {
+        const struct kernel *kn = &kernels[sel[k]];
+        double app_mib = mt * nr_repeats * kernel_app_arrays(kn) * nr_procs;
+        double window_sum = 0, agg_min = 0, agg_max = 0;
+        double start_skew_sum = 0, start_skew_max = 0, end_skew_sum = 0, end_skew_max = 0;
+        for (int j = 0; j < nr_loops; j++)
+        {
+            int idx = (j * nr_tests + k) * 2;
+            double first_start = mpstamps[1][idx], last_start = first_start;
+            double first_end = mpstamps[1][idx + 1], last_end = first_end;
+            for (int i = 2; i <= nr_procs; i++)
+            {
+                double s = mpstamps[i][idx], e = mpstamps[i][idx + 1];
+                first_start = s < first_start ? s : first_start;
+                last_start = s > last_start ? s : last_start;
+                first_end = e < first_end ? e : first_end;
+                last_end = e > last_end ? e : last_end;
+            }
+            double window = last_end - first_start;
+            double agg = app_mib / window;
+            window_sum += window;
+            agg_min = j == 0 || agg < agg_min ? agg : agg_min;
+            agg_max = agg > agg_max ? agg : agg_max;
+            start_skew_sum += last_start - first_start;
+            start_skew_max = last_start - first_start > start_skew_max ? last_start - first_start : start_skew_max;
+            end_skew_sum += last_end - first_end;
+            end_skew_max = last_end - first_end > end_skew_max ? last_end - first_end : end_skew_max;
+        }
+        double agg = app_mib * nr_loops / window_sum;
+        printf("%-10s %10.2lf %10.2lf %10.2lf %10.2lf | %10.1lf %10.1lf | %10.1lf %10.1lf\n", kn->name,
+               agg, agg_min, agg_max, agg * kernel_bus_arrays(kn) / kernel_app_arrays(kn),
+               start_skew_sum / nr_loops * 1e6, start_skew_max * 1e6, end_skew_sum / nr_loops * 1e6, end_skew_max * 1e6);
+    }
+}
+
+/* ------------------------------------------------------ */
+
+/* soak mode (-n 0): the workers run their test until told to stop and
+ * publish every sample in a ring in shared memory, the controller reads
+ * the rings every interval and prints the aggregate over time
+ */
+
+struct soak_sample
+{
+    double end;    /* timestamp() at the end of the sample */
+    double te;     /* elapsed time of the sample */
+    double te_sum; /* elapsed time of all samples up to this one */
+};
+
+/* single writer: the worker fills samples[head % SOAK_RING], then
+ * publishes it by storing head + 1. The slot of sample head may be
+ * half written, so only the last SOAK_RING - 1 samples can be read;
+ * readers that fall further behind lose the oldest, never the totals */
+struct soak_ring
+{
+    unsigned long long head; /* samples written so far */
+    struct soak_sample samples[SOAK_RING];
+} __attribute__((aligned(64)));
+
+volatile sig_atomic_t soak_stop = 0;
+
+void soak_signal(int sig)
+{
+    (void)sig;
+    soak_stop = 1;
+}
+
+/* worker side: run the test until the controller leaves ST_RUN */
+void soak_worker(struct slot *slot, struct kernel_args *ka, const struct kernel *kn, int nr_repeats,
+                 struct soak_ring *ring)
+{
+    unsigned long long head = 0;
+    double te_sum = 0;
+    /* don't outlive a controller that got killed; SIGTERM is ignored */
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    while (state_get(slot) == ST_RUN)
+    {
+        double te = worker(kn, ka, nr_repeats);
+        struct soak_sample *s = &ring->samples[head % SOAK_RING];
+        te_sum += te;
+        s->end = timestamp();
+        s->te = te;
+        s->te_sum = te_sum;
+        __atomic_store_n(&ring->head, ++head, __ATOMIC_RELEASE);
+    }
+}
+
+/* what the controller has read from one worker's ring so far */
+struct soak_reader
+{
+    unsigned long long tail; /* samples seen */
+    double te_sum;           /* elapsed time of the samples seen */
+    unsigned long long lost; /* samples overwritten before we got to them */
+};
+
+/* read the samples published since the last call: the count and
+ * elapsed time of all of them, and the fastest and slowest sample in
+ * MiB/s of those still in the ring
+ *
+ * return value: number of new samples
+ */
+unsigned long long soak_read(struct soak_ring *ring, struct soak_reader *r, double mib, double *te,
+                             double *sample_min, double *sample_max)
+{
+    unsigned long long head, from;
+    double last_sum, bw_min, bw_max;
+    /* the worker may lap us while we read; then the oldest entries and
+     * the total can be torn, so read them again */
+    do
+    {
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (head == r->tail)
+            return 0;
+        from = head - r->tail >= SOAK_RING ? head - SOAK_RING + 1 : r->tail;
+        last_sum = ring->samples[(head - 1) % SOAK_RING].te_sum;
+        bw_min = bw_max = mib / ring->samples[from % SOAK_RING].te;
+        for (unsigned long long j = from + 1; j < head; j++)
+        {
+            double bw = mib / ring->samples[j % SOAK_RING].te;
+            bw_min = bw < bw_min ? bw : bw_min;
+            bw_max = bw > bw_max ? bw : bw_max;
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&ring->head, __ATOMIC_RELAXED) - from >= SOAK_RING);
+
+    unsigned long long n = head - r->tail;
+    *te = last_sum - r->te_sum;
+    *sample_min = bw_min;
+    *sample_max = bw_max;
+    r->lost += from - r->tail;
+    r->tail = head;
+    r->te_sum = last_sum;
+    return n;
+}
+
+/* controller side: print one line per interval until SIGINT or SIGTERM,
+ * then stop the workers and print a summary; drift is relative to the
+ * mean of the first SOAK_BASELINE intervals with samples */
+void soak_controller(struct slot *procmap, struct soak_ring **rings, int nr_procs, const struct kernel *kn,
+                     int nr_repeats, double mt, double interval)
+{
+    struct soak_reader *readers = calloc(nr_procs + 1, sizeof(*readers));
+    double *rates = calloc(nr_procs + 1, sizeof(*rates));
+    double mib = mt * nr_repeats * kernel_app_arrays(kn);
+    double start = timestamp(), next = start, baseline = 0, drift = NAN;
+    double total_min = 0, total_max = 0, total_sum = 0;
+    int nr_intervals = 0, nr_baseline = 0;
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = soak_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    printf("\nSoak: %s, app MiB/s every %.3lf s until interrupted (drift vs. the first %d intervals):\n",
+           kn->name, interval, SOAK_BASELINE);
+    printf("%10s %12s %12s %5s %12s %5s %12s %12s %8s\n", "time(s)", "total", "worker min", "#", "worker max",
+           "#", "sample min", "sample max", "drift");
+    fflush(stdout);
+    while (!soak_stop)
+    {
+        double total = 0, wmin = 0, wmax = 0, smin = 0, smax = 0;
+        int imin = 0, imax = 0, nr_active = 0;
+
+        next += interval;
+        for (double now = timestamp(); now < next && !soak_stop; now = timestamp())
+            usleep((useconds_t)((next - now) * 1e6));
+        if (soak_stop)
+            break;
+        for (int i = 1; i <= nr_procs; i++)
+        {
+            double te, lo, hi;
+            unsigned long long n = soak_read(rings[i], &readers[i], mib, &te, &lo, &hi);
+            /* a worker without a finished sample keeps its last rate */
+            if (n)
+            {
+                rates[i] = mib * n / te;
+                smin = !nr_active || lo < smin ? lo : smin;
+                smax = hi > smax ? hi : smax;
+                nr_active++;
+            }
+            total += rates[i];
+            if (!imin || rates[i] < wmin)
+                wmin = rates[i], imin = i;
+            if (!imax || rates[i] > wmax)
+                wmax = rates[i], imax = i;
+        }
+        if (!nr_active)
+        {
+            printf("%10.1lf %12s\n", timestamp() - start, "no samples");
+            fflush(stdout);
+            continue;
+        }
+        if (nr_baseline < SOAK_BASELINE)
+            baseline = (baseline * nr_baseline + total) / (nr_baseline + 1), nr_baseline++;
+        else
+            drift = (total / baseline - 1) * 100;
+        total_min = !nr_intervals || total < total_min ? total : total_min;
+        total_max = total > total_max ? total : total_max;
+        total_sum += total;
+        nr_intervals++;
+        printf("%10.1lf %12.2lf %12.2lf %5d %12.2lf %5d %12.2lf %12.2lf ", timestamp() - start, total, wmin, imin,
+               wmax, imax, smin, smax);
+        if (isnan(drift))
+            printf("%8s\n", "-");
+        else
+            printf("%+7.1lf%%\n", drift);
+        fflush(stdout);
+    }
+
+    for (int i = 1; i <= nr_procs; i++)
+        state_set(&procmap[i], ST_STOP);
+    for (int i = 1; i <= nr_procs; i++)
+        state_wait(&procmap[i], ST_STOP);
+
+    double mean = 0;
+    unsigned long long samples = 0, lost = 0;
+    for (int i = 1; i <= nr_procs; i++)
+    {
+        double te, lo, hi;
+        soak_read(rings[i], &readers[i], mib, &te, &lo, &hi);
+        if (readers[i].te_sum > 0)
+            mean += mib * readers[i].tail / readers[i].te_sum;
+        samples += readers[i].tail;
+        lost += readers[i].lost;
+    }
+    printf("\nSoak of %.1lf s: %llu samples, mean %.2lf MiB/s", timestamp() - start, samples, mean);
+    if (nr_intervals)
+        printf(", intervals %.2lf avg %.2lf min %.2lf max", total_sum / nr_intervals, total_min, total_max);
+    if (!isnan(drift))
+        printf(", drift at the end %+.1lf%%", drift);
+    printf("\n");
+    if (lost)
+        printf("%llu samples were overwritten before they were read; min/max ignore them.\n", lost);
+    free(readers);
+    free(rates);
+}
+
+/* ------------------------------------------------------ */
+
+/* cold memory test: how fast fresh mappings can be faulted in, with
+ * every sample started together on all workers so they contend for
+ * mmap_lock and page zeroing */
+
+/* how a fault test faults its mapping in */
+enum
+{
+    FAULT_TOUCH,         /* a loop, one access per 4K page */
+    FAULT_MAP_POPULATE,  /* mmap(MAP_POPULATE) */
+    FAULT_MADV_POPULATE, /* madvise(MADV_POPULATE_WRITE) after the other madvise()s */
+};
+
+struct fault_test
+{
+    const char *name;
+    int backend;   /* ALLOC_NOTHP for 4K pages, ALLOC_THP, or ALLOC_MMAP for MAP_POPULATE */
+    int populate;  /* FAULT_* */
+    int write;     /* touch loop writes (else reads, which maps the zero page) */
+};
+
+struct fault_test fault_tests[] = {
+    {"4k-write", ALLOC_NOTHP, FAULT_TOUCH, 1},
+    {"4k-read", ALLOC_NOTHP, FAULT_TOUCH, 0},
+    {"4k-madv-pop", ALLOC_NOTHP, FAULT_MADV_POPULATE, 1},
+    {"thp-write", ALLOC_THP, FAULT_TOUCH, 1},
+    {"thp-read", ALLOC_THP, FAULT_TOUCH, 0},
+    {"thp-madv-pop", ALLOC_THP, FAULT_MADV_POPULATE, 1},
+    {"mmap-populate", ALLOC_MMAP, FAULT_MAP_POPULATE, 1},
+};
+
+#define NR_FAULT_TESTS ((int)(sizeof(fault_tests) / sizeof(fault_tests[0])))
+
+/* minor faults of this process so far */
+long minor_faults(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_minflt;
+}
+
+/* does the kernel have MADV_POPULATE_WRITE (5.14)? Without it
+ * alloc_array() falls back to touching the pages, which the
+ * FAULT_MADV_POPULATE tests would then only measure again */
+int have_madv_populate(void)
+{
+    static int have = -1;
+    if (have < 0)
+    {
+        void *p = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        have = p != MAP_FAILED && madvise(p, 4096, MADV_POPULATE_WRITE) == 0;
+        if (p != MAP_FAILED)
+            munmap(p, 4096);
+    }
+    return have;
+}
+
+/* can this kernel run the given fault test? */
+int fault_test_supported(const struct fault_test *ft)
+{
+    return ft->populate != FAULT_MADV_POPULATE || have_madv_populate();
+}
+
+/* map 'bytes' of fresh memory and fault all of it in, one touch per 4K
+ * page; the mapping is timed too, the munmap isn't
+ * faults: minor faults it took
+ *
+ * return value: elapsed time in seconds, -1 if the mapping failed
+ */
+double fault_in(const struct fault_test *ft, unsigned long long bytes, long *faults)
+{
+    long f0 = minor_faults();
+    double starttime = timestamp();
+    char *p = (char *)alloc_array(bytes, -1, ft->backend | (ft->populate ? ALLOC_POPULATE : 0));
+    long sum = 0;
+    if (!p)
+        return -1;
+    if (ft->populate == FAULT_TOUCH)
+    {
+        if (ft->write)
+            for (unsigned long long off = 0; off < bytes; off += 4096)
+                p[off] = 1;
+        else
+            for (unsigned long long off = 0; off < bytes; off += 4096)
+                sum += ((volatile char *)p)[off];
+    }
+    double elapsed = timestamp() - starttime;
+    *faults = minor_faults() - f0;
+    read_sink = sum;
+    free_array((long *)p, bytes / sizeof(long), -1, ft->backend);
+    return elapsed;
+}
+
+/* worker side: nr_loops fresh mappings of 'bytes' per fault test
+ * results: per row, the time of every test, then its fault count
+ */
+void fault_worker(int procno, unsigned long long bytes, int nr_loops, int quiet, struct barrier *bar,
+                  volatile double *results)
+{
+    int sense = 0;
+    for (int t = 0; t < NR_FAULT_TESTS; t++)
+    {
+        double te_sum = 0;
+        if (!fault_test_supported(&fault_tests[t]))
+            continue;
+        for (int i = 0; i < nr_loops; i++)
+        {
+            long faults = 0;
+            barrier_wait(bar, &sense);
+            double te = fault_in(&fault_tests[t], bytes, &faults);
+            if (te < 0)
+            {
+                perror("Error mapping memory");
+                exit(1);
+            }
+            te_sum += te;
+            results[(i + 1) * 2 * NR_FAULT_TESTS + t] = te;
+            results[(i + 1) * 2 * NR_FAULT_TESTS + NR_FAULT_TESTS + t] = faults;
+            if (!quiet)
+                printf("worker %d\t%d\tMethod: %s\tElapsed: %.5f\tFaults: %ld\tGiB/s: %.3f\n", procno, i,
+                       fault_tests[t].name, te, faults, bytes / te / (1 << 30));
+        }
+        results[t] = te_sum / nr_loops;
+    }
+}
+
+/* controller side: median fault throughput of every worker, and the
+ * total over the workers */
+void fault_report(volatile double **mpresults, int nr_procs, unsigned long long bytes, int nr_loops)
+{
+    double *gibs = malloc(sizeof(double) * nr_loops);
+    double *rate = malloc(sizeof(double) * nr_loops);
+    double *kib = malloc(sizeof(double) * nr_loops);
+    char buf[32];
+
+    printf("\nPage fault throughput, fresh mappings of %s per worker (median of %d samples):\n",
+           format_size(buf, bytes), nr_loops);
+    printf("%-14s %6s %12s %14s %10s\n", "test", "worker", "GiB/s", "faults/s", "KiB/fault");
+    for (int t = 0; t < NR_FAULT_TESTS; t++)
+    {
+        double total_gibs = 0, total_rate = 0;
+        if (!fault_test_supported(&fault_tests[t]))
+        {
+            printf("%-14s skipped: the kernel has no MADV_POPULATE_WRITE (needs Linux 5.14)\n", fault_tests[t].name);
+            continue;
+        }
+        for (int i = 1; i <= nr_procs; i++)
+        {
+            struct stats st_gibs, st_rate, st_kib;
+            for (int j = 0; j < nr_loops; j++)
+            {
+                double te = mpresults[i][(j + 1) * 2 * NR_FAULT_TESTS + t];
+                double faults = mpresults[i][(j + 1) * 2 * NR_FAULT_TESTS + NR_FAULT_TESTS + t];
+                gibs[j] = bytes / te / (1 << 30);
+                rate[j] = faults / te;
+                kib[j] = faults ? bytes / faults / 1024 : 0;
+            }
+            compute_stats(&st_gibs, gibs, nr_loops);
+            compute_stats(&st_rate, rate, nr_loops);
+            compute_stats(&st_kib, kib, nr_loops);
+            total_gibs += st_gibs.median;
+            total_rate += st_rate.median;
+            printf("%-14s %6d %12.3lf %14.0lf %10.1lf\n", fault_tests[t].name, i, st_gibs.median, st_rate.median,
+                   st_kib.median);
+        }
+        if (nr_procs > 1)
+            printf("%-14s %6s %12.3lf %14.0lf\n", fault_tests[t].name, "all", total_gibs, total_rate);
+    }
+    free(kib);
+    free(rate);
+    free(gibs);
+}
+
+/* ------------------------------------------------------ */
+
+/* shared buffer mode: one process with a pool of pinned threads that
+ * work on one set of arrays together, the way a multi-threaded service
+ * copies or scans one big buffer */
+
+/* how the arrays are split between the threads */
+enum
+{
+    SHARED_STATIC,     /* one contiguous share per thread */
+    SHARED_INTERLEAVE, /* -b sized blocks, round robin */
+    SHARED_STEAL,      /* static shares of blocks, idle threads steal */
+};
+
+const char *partition_names[] = {"static", "interleave", "steal"};
+
+/* a thread's blocks for SHARED_STEAL, next << 32 | end: the owner
+ * takes them from the front, thieves from the back */
+struct steal_range
+{
+    uint64_t range;
+} __attribute__((aligned(64)));
+
+struct shared_pool
+{
+    const struct kernel *k;  /* test being run */
+    struct kernel_args ka;    /* the whole arrays, and the current repeat */
+    int partition;            /* SHARED_* */
+    unsigned long long chunk; /* block size of SHARED_INTERLEAVE and SHARED_STEAL */
+    unsigned long long nr_blocks;
+    int nr_threads;
+    int stop;                 /* the threads exit at the next start barrier */
+    struct barrier bar;       /* the threads and the controlling thread */
+    struct steal_range *ranges;
+};
+
+struct shared_thread
+{
+    struct shared_pool *pool;
+    int id;
+    int cpu;
+};
+
+/* run the current test on bytes [off, off + len) of the arrays */
+void shared_chunk(const struct shared_pool *pool, unsigned long long off, unsigned long long len)
+{
+    struct kernel_args ka = pool->ka;
+    ka.a += off / sizeof(long);
+    ka.b = ka.b ? ka.b + off / sizeof(long) : NULL;
+    ka.c = ka.c ? ka.c + off / sizeof(long) : NULL;
+    ka.asize = len / sizeof(long);
+    ka.array_bytes = len;
+    run_kernel(pool->k, &ka, pool->ka.rep);
+}
+
+/* take a block from the front (the owner) or the back (a thief) of a
+ * range, -1 if it is empty */
+long long steal_block(struct steal_range *r, int back)
+{
+    uint64_t old = __atomic_load_n(&r->range, __ATOMIC_ACQUIRE), new;
+    for (;;)
+    {
+        uint32_t next = old >> 32, end = (uint32_t)old;
+        if (next >= end)
+            return -1;
+        new = back ? (uint64_t)next << 32 | (end - 1) : (uint64_t)(next + 1) << 32 | end;
+        if (__atomic_compare_exchange_n(&r->range, &old, new, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return back ? end - 1 : next;
+    }
+}
+
+/* static share of thread 'id' out of n, in units of 'unit'
+ * rounded so the shares start on cache line boundaries */
+unsigned long long shared_split(unsigned long long total, int id, int n, unsigned long long unit)
+{
+    return id >= n ? total : total * id / n / unit * unit;
+}
+
+/* one thread's part of one pass over the arrays */
+void shared_pass(struct shared_pool *pool, int id)
+{
+    unsigned long long total = pool->ka.array_bytes, chunk = pool->chunk;
+    int n = pool->nr_threads;
+
+    if (pool->partition == SHARED_STATIC)
+    {
+        unsigned long long start = shared_split(total, id, n, 64), end = shared_split(total, id + 1, n, 64);
+        if (end > start)
+            shared_chunk(pool, start, end - start);
+    }
+    else if (pool->partition == SHARED_INTERLEAVE)
+    {
+        for (unsigned long long blk = id; blk < pool->nr_blocks; blk += n)
+            shared_chunk(pool, blk * chunk, blk * chunk + chunk > total ? total - blk * chunk : chunk);
+    }
+    else
+    {
+        long long blk;
+        for (int v = 0; v < n; v++)
+        {
+            struct steal_range *r = &pool->ranges[(id + v) % n];
+            while ((blk = steal_block(r, v != 0)) >= 0)
+                shared_chunk(pool, blk * chunk, blk * chunk + chunk > total ? total - blk * chunk : chunk);
+        }
+    }
+}
+
+void *shared_thread(void *arg)
+{
+    struct shared_thread *st = arg;
+    struct shared_pool *pool = st->pool;
+    cpu_set_t set;
+    int sense = 0;
+
+    CPU_ZERO(&set);
+    CPU_SET(st->cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    for (;;)
+    {
+        barrier_wait(&pool->bar, &sense);
+        if (pool->stop)
+            break;
+        shared_pass(pool, st->id);
+        barrier_wait(&pool->bar, &sense);
+    }
+    return NULL;
+}
+
+/* run the selected tests on the shared arrays with 1 up to nr_threads
+ * threads, pinned to the -f cpus, and print one scaling table per test
+ * with the point where adding threads stops paying off */
+void shared_controller(struct kernel_args *full, const int *sel, int nr_tests, int partition, int nr_threads,
+                       const int *cpu_pinno, int nr_loops, int nr_repeats, double mt, int quiet)
+{
+    struct shared_pool pool;
+    struct shared_thread *threads = malloc(sizeof(*threads) * nr_threads);
+    pthread_t *tids = malloc(sizeof(*tids) * nr_threads);
+    /* median app bandwidth per thread count and test */
+    double(*bw)[NR_KERNELS] = malloc(sizeof(*bw) * (nr_threads + 1));
+    double *samples = malloc(sizeof(double) * nr_loops);
+    char buf[32];
+
+    memset(&pool, 0, sizeof(pool));
+    pool.ka = *full;
+    pool.partition = partition;
+    /* blocks on cache line boundaries */
+    pool.chunk = full->block_size < 64 ? 64 : full->block_size / 64 * 64;
+    pool.nr_blocks = (full->array_bytes + pool.chunk - 1) / pool.chunk;
+    pool.ranges = aligned_alloc(64, sizeof(*pool.ranges) * nr_threads);
+    if (pool.nr_blocks > UINT32_MAX)
+    {
+        printf("Error: too many blocks, use a larger -b\n");
+        exit(1);
+    }
+
+    for (int n = 1; n <= nr_threads; n++)
+    {
+        int sense = 0;
+        pool.nr_threads = n;
+        pool.stop = 0;
+        pool.bar.count = 0;
+        pool.bar.sense = 0;
+        pool.bar.nr_procs = n + 1;
+        for (int t = 0; t < n; t++)
+        {
+            threads[t].pool = &pool;
+            threads[t].id = t;
+            threads[t].cpu = cpu_pinno[t + 1];
+            if (pthread_create(&tids[t], NULL, shared_thread, &threads[t]))
+            {
+                perror("Error creating threads");
+                exit(1);
+            }
+        }
+        for (int k = 0; k < nr_tests; k++)
+        {
+            const struct kernel *kn = &kernels[sel[k]];
+            struct stats st;
+            pool.k = kn;
+            for (int i = 0; i < nr_loops; i++)
+            {
+                double te = 0;
+                for (int rep = 0; rep < nr_repeats; rep++)
+                {
+                    pool.ka.rep = rep;
+                    for (int t = 0; t < n && partition == SHARED_STEAL; t++)
+                        pool.ranges[t].range = shared_split(pool.nr_blocks, t, n, 1) << 32 |
+                                               shared_split(pool.nr_blocks, t + 1, n, 1);
+                    double t0 = timestamp();
+                    barrier_wait(&pool.bar, &sense);
+                    barrier_wait(&pool.bar, &sense);
+                    te += timestamp() - t0;
+                }
+                samples[i] = mt * nr_repeats * kernel_app_arrays(kn) / te;
+                if (!quiet)
+                {
+                    printf("threads %d\t%d\t", n, i);
+                    printout(te, mt * nr_repeats, kn);
+                }
+            }
+            compute_stats(&st, samples, nr_loops);
+            bw[n][k] = st.median;
+        }
+        pool.stop = 1;
+        barrier_wait(&pool.bar, &sense);
+        for (int t = 0; t < n; t++)
+            pthread_join(tids[t], NULL);
+        if (!quiet)
+            fflush(stdout);
+    }
+
+    for (int k = 0; k < nr_tests; k++)
+    {
+        double best = 0;
+        int best_n = 1, saturated = 1;
+        for (int n = 1; n <= nr_threads; n++)
+        {
+            if (bw[n][k] > best)
+            {
+                best = bw[n][k];
+                best_n = n;
+            }
+        }
+        for (saturated = 1; bw[saturated][k] < SHARED_SATURATION * best; saturated++)
+            ;
+        printf("\nShared %s of %s, %s partitioning (median app MiB/s):\n", kernels[sel[k]].name,
+               format_size(buf, full->array_bytes), partition_names[partition]);
+        printf("%8s %12s %8s %10s  %s\n", "threads", "MiB/s", "speedup", "efficiency", "cpu");
+        for (int n = 1; n <= nr_threads; n++)
+            printf("%8d %12.2lf %7.2lfx %9.1lf%%  %d\n", n, bw[n][k], bw[n][k] / bw[1][k],
+                   100 * bw[n][k] / bw[1][k] / n, cpu_pinno[n]);
+        printf("Saturates at %d threads (%.0lf%% of the best, %.2lf MiB/s with %d threads).\n", saturated,
+               SHARED_SATURATION * 100, best, best_n);
+    }
+    free(samples);
+    free(bw);
+    free(pool.ranges);
+    free(tids);
+    free(threads);
+}
+
+/* ------------------------------------------------------ */
+
+/* small copies: ns per call of every copy implementation on sizes up
+ * to a few KiB, hot in the cache, in one process pinned to the first
+ * -f cpu */
+
+/* src/dst distance from a cache line boundary of each variant */
+const int small_aligns[][2] = {{0, 0}, {1, 0}, {0, 1}, {1, 1}};
+
+#define NR_SMALL_ALIGNS ((int)(sizeof(small_aligns) / sizeof(small_aligns[0])))
+
+void copy_libc(void *dst, const void *src, size_t n)
+{
+    memcpy(dst, src, n);
+}
+
+/* byte at a time, volatile so the compiler can't turn it into memcpy */
+void copy_naive(void *dst, const void *src, size_t n)
+{
+    volatile char *d = dst;
+    const volatile char *s = src;
+    for (size_t i = 0; i < n; i++)
+        d[i] = s[i];
+}
+
+/* the copy function a test stands for in the small copy test: memcpy is
+ * glibc, dumb the naive loop; NULL for the tests that aren't copies */
+copy_fn small_copy_fn(const struct kernel *k)
+{
+    if (k->copy)
+        return k->copy;
+    if (k->run == run_memcpy)
+        return copy_libc;
+    if (k->run == run_dumb)
+        return copy_naive;
+    return NULL;
+}
+
+/* time 'iters' calls of fn */
+double small_time(copy_fn fn, char *dst, const char *src, size_t n, long iters)
+{
+    double starttime = timestamp();
+    for (long i = 0; i < iters; i++)
+        fn(dst, src, n);
+    return timestamp() - starttime;
+}
+
+void small_copies(const int *sel, int nr_tests, const unsigned long long *sizes, int nr_sizes, int cpu,
+                  int nr_loops, int quiet)
+{
+    unsigned long long max = sizes[nr_sizes - 1];
+    char *src = aligned_alloc(64, max + 128), *dst = aligned_alloc(64, max + 128);
+    /* median ns per call: [align][size][test] */
+    double *ns = malloc(sizeof(double) * NR_SMALL_ALIGNS * nr_sizes * nr_tests);
+    double *samples = malloc(sizeof(double) * nr_loops);
+    cpu_set_t set;
+    char buf[32];
+#define NS(al, s, k) ns[((al) * nr_sizes + (s)) * nr_tests + (k)]
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+    memset(src, 0xaa, max + 128);
+    memset(dst, 0x55, max + 128);
+
+    for (int al = 0; al < NR_SMALL_ALIGNS; al++)
+    {
+        const char *s_ = src + small_aligns[al][0];
+        char *d_ = dst + small_aligns[al][1];
+        for (int s = 0; s < nr_sizes; s++)
+        {
+            for (int k = 0; k < nr_tests; k++)
+            {
+                copy_fn fn = small_copy_fn(&kernels[sel[k]]);
+                struct stats st;
+                long iters = SMALL_MIN_CALLS;
+                /* enough calls for one sample to be well above the timer's resolution */
+                while (small_time(fn, d_, s_, sizes[s], iters) < SMALL_SAMPLE_SECONDS)
+                    iters *= 2;
+                for (int i = 0; i < nr_loops; i++)
+                    samples[i] = small_time(fn, d_, s_, sizes[s], iters) / iters * 1e9;
+                compute_stats(&st, samples, nr_loops);
+                NS(al, s, k) = st.median;
+            }
+        }
+        if (!quiet)
+        {
+            printf("src+%d dst+%d done\n", small_aligns[al][0], small_aligns[al][1]);
+            fflush(stdout);
+        }
+    }
+
+    if (!tsc_hz)
+        printf("No invariant TSC, can't count bytes per cycle.\n");
+    for (int al = 0; al < NR_SMALL_ALIGNS; al++)
+    {
+        printf("\nSmall copies, src+%d dst+%d bytes from a cache line, hot (median ns/call, bytes/TSC cycle):\n",
+               small_aligns[al][0], small_aligns[al][1]);
+        printf("%8s", "size");
+        for (int k = 0; k < nr_tests; k++)
+            printf(" %17s", kernels[sel[k]].name);
+        printf("\n");
+        for (int s = 0; s < nr_sizes; s++)
+        {
+            printf("%8s", format_size(buf, sizes[s]));
+            for (int k = 0; k < nr_tests; k++)
+            {
+                if (tsc_hz)
+                    printf(" %9.2lf %7.2lf", NS(al, s, k), sizes[s] / (NS(al, s, k) * 1e-9 * tsc_hz));
+                else
+                    printf(" %9.2lf %7s", NS(al, s, k), "-");
+            }
+            printf("\n");
+        }
+    }
+#undef NS
+    free(samples);
+    free(ns);
+    free(dst);
+    free(src);
+}
+
+/* ------------------------------------------------------ */
+
+/* cross-process copies: move a message from a partner process (the
+ * sender, on the second -f cpu) to us (the receiver, on the first) with
+ * every way the kernel offers, next to memcpy in one process */
+
+enum
+{
+    IPC_MEMCPY,        /* memcpy within the receiver */
+    IPC_SHM,           /* sender writes a message into shared memory, receiver reads it in place */
+    IPC_VM_READV,      /* receiver pulls from the sender's memory */
+    IPC_VM_WRITEV,     /* receiver pushes into the sender's memory */
+    IPC_PIPE,          /* write() into a pipe, read() out of it */
+    IPC_VMSPLICE,      /* vmsplice() the sender's pages into a pipe, read() out of it */
+    IPC_SENDFILE,      /* sendfile() from a memfd into a pipe, read() out of it */
+    IPC_COPY_FILE_RANGE, /* receiver copies between two memfds, in-process like memcpy */
+    NR_IPC_METHODS,
+};
+
+const char *ipc_names[NR_IPC_METHODS] = {
+    "memcpy", "shm", "vm_readv", "vm_writev", "pipe", "vmsplice", "sendfile", "copy_range",
+};
+
+/* the methods that need the sender to do something */
+#define IPC_HAS_SENDER(m) ((m) == IPC_SHM || (m) == IPC_PIPE || (m) == IPC_VMSPLICE || (m) == IPC_SENDFILE)
+/* the methods that never cross processes, shown only for reference */
+#define IPC_IN_PROCESS(m) ((m) == IPC_MEMCPY || (m) == IPC_COPY_FILE_RANGE)
+
+/* shared between the receiver and the sender */
+struct ipc_ctl
+{
+    struct slot sender; /* ST_RUN: send, ST_DONE: sent */
+    int seq;            /* IPC_SHM: messages published */
+    int ack;            /* IPC_SHM: messages consumed */
+    int method;
+    size_t size;
+    long calls;       /* messages per sample, plus one untimed */
+    int err;          /* errno of the sender's method, 0 if it worked */
+    char *sender_buf; /* the sender's private buffer */
+};
+
+int write_all(int fd, const char *buf, size_t n)
+{
+    while (n)
+    {
+        ssize_t r = write(fd, buf, n);
+        if (r < 0)
+            return -1;
+        buf += r;
+        n -= r;
+    }
+    return 0;
+}
+
+int read_all(int fd, char *buf, size_t n)
+{
+    while (n)
+    {
+        ssize_t r = read(fd, buf, n);
+        if (r <= 0)
+            return -1;
+        buf += r;
+        n -= r;
+    }
+    return 0;
+}
+
+/* sender side of one message
+ *
+ * return value: bytes sent, less than 'size' on error with errno set
+ */
+size_t ipc_send_one(int method, const char *buf, size_t size, int pipe_w, int memfd)
+{
+    size_t done = 0;
+    off_t off = 0;
+    while (done < size)
+    {
+        ssize_t r;
+        if (method == IPC_VMSPLICE)
+        {
+            struct iovec iov = {(void *)(buf + done), size - done};
+            r = vmsplice(pipe_w, &iov, 1, 0);
+        }
+        else if (method == IPC_SENDFILE)
+            r = sendfile(pipe_w, memfd, &off, size - done);
+        else
+            r = write(pipe_w, buf + done, size - done);
+        if (r <= 0)
+            break;
+        done += r;
+    }
+    return done;
+}
+
+/* sender side of one sample; if its method fails the rest goes through
+ * write() so the receiver doesn't wait forever, and ctl->err says so */
+void ipc_send(struct ipc_ctl *ctl, const char *buf, char *shm, int pipe_w, int memfd)
+{
+    int method = ctl->method;
+    ctl->err = 0;
+    for (long i = 1; i <= ctl->calls; i++)
+    {
+        if (method == IPC_SHM)
+        {
+            /* write every line of the message so the receiver has to pull
+             * them from this cpu, then hand it off */
+            memset(shm, (int)i, ctl->size);
+            futex_store(&ctl->seq, i);
+            futex_wait_while(&ctl->ack, i - 1);
+            continue;
+        }
+        size_t done = ipc_send_one(method, buf, ctl->size, pipe_w, memfd);
+        if (done < ctl->size)
+        {
+            ctl->err = errno ? errno : EIO;
+            method = IPC_PIPE;
+            write_all(pipe_w, buf + done, ctl->size - done);
+        }
+    }
+}
+
+/* receiver side of one sample: ctl->calls messages, the first untimed
+ *
+ * return value: seconds for the others, -1 on error with errno set
+ */
+double ipc_receive(struct ipc_ctl *ctl, pid_t sender, char *dst, const char *src, long *shm, int pipe_r,
+                   int memfd_src, int memfd_dst)
+{
+    double starttime = 0;
+    size_t size = ctl->size;
+    for (long i = 1; i <= ctl->calls; i++)
+    {
+        if (i == 2)
+            starttime = timestamp();
+        switch (ctl->method)
+        {
+        case IPC_MEMCPY:
+            memcpy(dst, src, size);
+            break;
+        case IPC_SHM:
+        {
+            struct kernel_args ka = {.a = shm, .asize = size / sizeof(long)};
+            futex_wait_while(&ctl->seq, i - 1);
+            run_read(&ka);
+            futex_store(&ctl->ack, i);
+            break;
+        }
+        case IPC_VM_READV:
+        case IPC_VM_WRITEV:
+            for (size_t done = 0; done < size;)
+            {
+                struct iovec local = {(ctl->method == IPC_VM_READV ? dst : (char *)src) + done, size - done};
+                struct iovec remote = {ctl->sender_buf + done, size - done};
+                ssize_t r = ctl->method == IPC_VM_READV ? process_vm_readv(sender, &local, 1, &remote, 1, 0)
+                                                        : process_vm_writev(sender, &local, 1, &remote, 1, 0);
+                if (r <= 0)
+                    return -1;
+                done += r;
+            }
+            break;
+        case IPC_COPY_FILE_RANGE:
+        {
+            loff_t in = 0, out = 0;
+            for (size_t done = 0; done < size;)
+            {
+                ssize_t r = copy_file_range(memfd_src, &in, memfd_dst, &out, size - done, 0);
+                if (r <= 0)
+                    return -1;
+                done += r;
+            }
+            break;
+        }
+        default:
+            if (read_all(pipe_r, dst, size) < 0)
+                return -1;
+            break;
+        }
+    }
+    return timestamp() - starttime;
+}
+
+/* the sender: allocate its buffer, then send whenever told to */
+void ipc_sender(struct ipc_ctl *ctl, size_t max, int cpu, char *shm, int pipe_w, int memfd)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+    ctl->sender_buf = aligned_alloc(4096, max);
+    if (!ctl->sender_buf)
+    {
+        state_set(&ctl->sender, ST_ABORT);
+        exit(1);
+    }
+    memset(ctl->sender_buf, 0xaa, max);
+    state_set(&ctl->sender, ST_READY);
+    for (int state = ST_READY;; state = ST_DONE)
+    {
+        worker_wait(&ctl->sender, state);
+        ipc_send(ctl, ctl->sender_buf, shm, pipe_w, memfd);
+        state_set(&ctl->sender, ST_DONE);
+    }
+}
+
+/* fork a sender with a fresh pipe to it; the read end goes to *pipe_r
+ *
+ * return value: the sender's pid, -1 if it couldn't be started
+ */
+pid_t ipc_start_sender(struct ipc_ctl *ctl, size_t max, int cpu, char *shm, int memfd, int *pipe_r)
+{
+    int pipefd[2];
+    pid_t sender;
+    if (pipe(pipefd) < 0)
+        return -1;
+    /* as large as we may, so big messages don't go one page ring at a time */
+    fcntl(pipefd[1], F_SETPIPE_SZ, IPC_PIPE_SIZE);
+    state_set(&ctl->sender, ST_FORKED);
+    fflush(stdout);
+    sender = fork();
+    if (sender == 0)
+    {
+        close(pipefd[0]);
+        ipc_sender(ctl, max, cpu, shm, pipefd[1], memfd);
+    }
+    close(pipefd[1]);
+    if (sender < 0 || state_wait(&ctl->sender, ST_FORKED) != ST_READY)
+    {
+        if (sender > 0)
+            waitpid(sender, NULL, 0);
+        close(pipefd[0]);
+        return -1;
+    }
+    *pipe_r = pipefd[0];
+    return sender;
+}
+
+void ipc_copies(const unsigned long long *sizes, int nr_sizes, int cpu, int sender_cpu, int nr_loops, int quiet)
+{
+    size_t max = sizes[nr_sizes - 1];
+    struct ipc_ctl *ctl = mmap(NULL, sizeof(*ctl), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    long *shm = mmap(NULL, max, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    char *src = aligned_alloc(4096, max), *dst = aligned_alloc(4096, max);
+    /* median seconds per message: [size][method], NAN if it failed */
+    double *sec = malloc(sizeof(double) * nr_sizes * NR_IPC_METHODS);
+    double *samples = malloc(sizeof(double) * nr_loops);
+    int errs[NR_IPC_METHODS] = {0};
+    int pipe_r, memfd_src, memfd_dst;
+    cpu_set_t set;
+    char buf[32];
+    pid_t sender;
+#define SEC(s, m) sec[(s) * NR_IPC_METHODS + (m)]
+
+    if (ctl == MAP_FAILED || shm == MAP_FAILED || !src || !dst)
+    {
+        perror("can't set up the cross-process copies");
+        exit(1);
+    }
+    memfd_src = memfd_create("mbw-ipc-src", 0);
+    memfd_dst = memfd_create("mbw-ipc-dst", 0);
+    if (memfd_src < 0 || memfd_dst < 0 || ftruncate(memfd_dst, max) < 0)
+        errs[IPC_SENDFILE] = errs[IPC_COPY_FILE_RANGE] = errno;
+    memset(src, 0xaa, max);
+    memset(dst, 0x55, max);
+    memset(shm, 0xaa, max);
+    if (memfd_src >= 0 && write_all(memfd_src, src, max) < 0)
+        errs[IPC_SENDFILE] = errs[IPC_COPY_FILE_RANGE] = errno;
+
+    sender = ipc_start_sender(ctl, max, sender_cpu, (char *)shm, memfd_src, &pipe_r);
+    if (sender < 0)
+    {
+        printf("The sender failed to start with %zu bytes. Exiting...\n", max);
+        exit(1);
+    }
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+
+    for (int s = 0; s < nr_sizes; s++)
+    {
+        long calls = IPC_TARGET_BYTES / sizes[s];
+        for (int m = 0; m < NR_IPC_METHODS; m++)
+        {
+            struct stats st;
+            SEC(s, m) = NAN;
+            if (errs[m])
+                continue;
+            ctl->method = m;
+            ctl->size = sizes[s];
+            ctl->calls = (calls > IPC_MIN_CALLS ? calls : IPC_MIN_CALLS) + 1;
+            for (int i = 0; i < nr_loops && !errs[m]; i++)
+            {
+                double t;
+                errno = 0;
+                ctl->seq = ctl->ack = 0;
+                if (IPC_HAS_SENDER(m))
+                    state_set(&ctl->sender, ST_RUN);
+                t = ipc_receive(ctl, sender, dst, src, shm, pipe_r, memfd_src, memfd_dst);
+                if (t < 0)
+                    errs[m] = errno ? errno : EIO;
+                if (t < 0 && IPC_HAS_SENDER(m))
+                {
+                    /* the sender would wait forever for us to take the
+                     * rest: replace it, and its pipe with whatever is
+                     * left in it */
+                    kill(sender, SIGKILL);
+                    waitpid(sender, NULL, 0);
+                    close(pipe_r);
+                    sender = ipc_start_sender(ctl, max, sender_cpu, (char *)shm, memfd_src, &pipe_r);
+                    if (sender < 0)
+                    {
+                        printf("The sender failed to restart. Exiting...\n");
+                        exit(1);
+                    }
+                }
+                else if (IPC_HAS_SENDER(m))
+                {
+                    state_wait(&ctl->sender, ST_RUN);
+                    if (ctl->err)
+                        errs[m] = ctl->err;
+                }
+                samples[i] = t / (ctl->calls - 1);
+            }
+            if (errs[m])
+            {
+                printf("%s: %s\n", ipc_names[m], strerror(errs[m]));
+                continue;
+            }
+            compute_stats(&st, samples, nr_loops);
+            SEC(s, m) = st.median;
+        }
+        if (!quiet)
+        {
+            printf("%s done\n", format_size(buf, sizes[s]));
+            fflush(stdout);
+        }
+    }
+    state_set(&ctl->sender, ST_EXIT);
+    waitpid(sender, NULL, 0);
+
+    printf("\nCross-process copies from cpu %d to cpu %d (median MiB/s, us/message):\n", sender_cpu, cpu);
+    printf("%8s", "size");
+    for (int m = 0; m < NR_IPC_METHODS; m++)
+        printf(" %20s", ipc_names[m]);
+    printf("  %s\n", "fastest");
+    for (int s = 0; s < nr_sizes; s++)
+    {
+        int best = -1;
+        printf("%8s", format_size(buf, sizes[s]));
+        for (int m = 0; m < NR_IPC_METHODS; m++)
+        {
+            if (isnan(SEC(s, m)))
+            {
+                printf(" %20s", "-");
+                continue;
+            }
+            printf(" %10.2lf %9.2lf", sizes[s] / SEC(s, m) / 1024 / 1024, SEC(s, m) * 1e6);
+            if (!IPC_IN_PROCESS(m) && (best < 0 || SEC(s, m) < SEC(s, best)))
+                best = m;
+        }
+        printf("  %s\n", best < 0 ? "-" : ipc_names[best]);
+    }
+    printf("memcpy and copy_range run in the receiver alone and are never the fastest\n");
+#undef SEC
+    if (memfd_src >= 0)
+        close(memfd_src);
+    if (memfd_dst >= 0)
+        close(memfd_dst);
+    close(pipe_r);
+    free(samples);
+    free(sec);
+    free(dst);
+    free(src);
+    munmap(shm, max);
+    munmap(ctl, sizeof(*ctl));
+}
+
+/* ------------------------------------------------------ */
+
+/* core to core latency: two threads pinned to a pair of -f cpus bounce
+ * a cache line between them, for every pair */
+
+struct c2c_pong
+{
+    long *line;
+    int cpu;
+    long rounds; /* round trips to answer */
+    long spins;  /* before each sched_yield() */
+};
+
+void pin_self(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/* spin until *line is 'value', yielding every 'spins' tries so two
+ * threads on the same cpu still get somewhere */
+void c2c_wait(long *line, long value, long spins)
+{
+    for (long i = 1; __atomic_load_n(line, __ATOMIC_ACQUIRE) != value; i++)
+    {
+        cpu_relax();
+        if (i % spins == 0)
+            sched_yield();
+    }
+}
+
+/* the far end: answer every odd value with the next even one */
+void *c2c_pong(void *arg)
+{
+    struct c2c_pong *p = arg;
+    pin_self(p->cpu);
+    for (long r = 1; r <= p->rounds; r++)
+    {
+        c2c_wait(p->line, 2 * r - 1, p->spins);
+        __atomic_store_n(p->line, 2 * r, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/* median round trip in ns between the calling thread on 'cpu' and a
+ * thread on 'peer', over nr_loops samples of C2C_ROUND_TRIPS each */
+double c2c_pair(int cpu, int peer, int nr_loops, double *samples)
+{
+    struct c2c_pong p;
+    struct stats st;
+    pthread_t tid;
+    long r = 0;
+
+    pin_self(cpu);
+    /* its own 128 bytes, so the adjacent line prefetcher brings in nothing else */
+    p.line = aligned_alloc(C2C_LINE, C2C_LINE);
+    *p.line = 0;
+    p.cpu = peer;
+    p.rounds = C2C_WARMUP + (long)nr_loops * C2C_ROUND_TRIPS;
+    /* the same cpu twice in -f: spinning only burns the time slice */
+    p.spins = cpu == peer ? 1 : SPIN_WAIT_LOOPS;
+    if (pthread_create(&tid, NULL, c2c_pong, &p))
+    {
+        perror("Error creating threads");
+        exit(1);
+    }
+    while (r < C2C_WARMUP)
+    {
+        r++;
+        __atomic_store_n(p.line, 2 * r - 1, __ATOMIC_RELEASE);
+        c2c_wait(p.line, 2 * r, p.spins);
+    }
+    for (int i = 0; i < nr_loops; i++)
+    {
+        double starttime = timestamp();
+        for (long j = 0; j < C2C_ROUND_TRIPS; j++)
+        {
+            r++;
+            __atomic_store_n(p.line, 2 * r - 1, __ATOMIC_RELEASE);
+            c2c_wait(p.line, 2 * r, p.spins);
+        }
+        samples[i] = (timestamp() - starttime) / C2C_ROUND_TRIPS * 1e9;
+    }
+    pthread_join(tid, NULL);
+    free(p.line);
+    compute_stats(&st, samples, nr_loops);
+    return st.median;
+}
+
+/* every pair of the -f cpus, both ways; print one way latency (half the
+ * round trip) as a matrix */
+void c2c_matrix(const int *cpus, int nr_cpus, int nr_loops, int quiet)
+{
+    double *ns = malloc(sizeof(double) * nr_cpus * nr_cpus);
+    double *samples = malloc(sizeof(double) * nr_loops);
+    int lo_i = -1, lo_j = -1, hi_i = -1, hi_j = -1;
+#define NS(i, j) ns[(i) * nr_cpus + (j)]
+
+    for (int i = 0; i < nr_cpus; i++)
+    {
+        for (int j = 0; j < nr_cpus; j++)
+        {
+            if (i == j)
+            {
+                NS(i, j) = NAN;
+                continue;
+            }
+            NS(i, j) = c2c_pair(cpus[i], cpus[j], nr_loops, samples) / 2;
+            if (lo_i < 0 || NS(i, j) < NS(lo_i, lo_j))
+                lo_i = i, lo_j = j;
+            if (hi_i < 0 || NS(i, j) > NS(hi_i, hi_j))
+                hi_i = i, hi_j = j;
+        }
+        if (!quiet)
+        {
+            printf("cpu %d done\n", cpus[i]);
+            fflush(stdout);
+        }
+    }
+
+    printf("\nCore to core latency (median one way ns, half a round trip; row pings, column answers):\n");
+    printf("%6s", "cpu");
+    for (int j = 0; j < nr_cpus; j++)
+        printf(" %7d", cpus[j]);
+    printf("\n");
+    for (int i = 0; i < nr_cpus; i++)
+    {
+        printf("%6d", cpus[i]);
+        for (int j = 0; j < nr_cpus; j++)
+        {
+            if (isnan(NS(i, j)))
+                printf(" %7s", "-");
+            else
+                printf(" %7.1lf", NS(i, j));
+        }
+        printf("\n");
+    }
+    printf("Closest: cpu %d -> %d %.1lf ns, farthest: cpu %d -> %d %.1lf ns\n", cpus[lo_i], cpus[lo_j],
+           NS(lo_i, lo_j), cpus[hi_i], cpus[hi_j], NS(hi_i, hi_j));
+#undef NS
+    free(samples);
+    free(ns);
+}
+
+/* ------------------------------------------------------ */
+
+/* producer/consumer rings: a forked producer on the first -f cpu copies
+ * fixed size messages into a single producer, single consumer ring in
+ * shared memory, a forked consumer on one of the other cpus copies them
+ * out; for every message size, ring size and consumer cpu */
+
+enum
+{
+    PLACE_SAME_CPU,
+    PLACE_SMT,
+    PLACE_L3,
+    PLACE_SOCKET,
+    PLACE_REMOTE,
+};
 
-    a = calloc(asize, long_size);
+const char *place_names[] = {"same cpu", "SMT sibling", "same L3", "same socket", "other socket"};
 
-    if (NULL == a)
-    {
-        perror("Error allocating memory");
-        exit(1);
-    }
+/* is 'cpu' in the sysfs cpu list at /sys/devices/system/cpu/cpu<of>/<file> */
+int cpu_in_sysfs_list(int of, const char *file, int cpu)
+{
+    static int cpus[CPU_SETSIZE];
+    char path[256];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/%s", of, file);
+    int n = read_sysfs_list(cpus, CPU_SETSIZE, path);
+    for (int i = 0; i < n; i++)
+        if (cpus[i] == cpu)
+            return 1;
+    return 0;
+}
 
-    /* make sure both arrays are allocated, fill with pattern */
-    for (t = 0; t < asize; t++)
+/* how close two cpus are, from the sysfs topology; cpus we know nothing
+ * about count as being on other sockets */
+int cpu_placement(int a, int b)
+{
+    char path[128];
+    if (a == b)
+        return PLACE_SAME_CPU;
+    if (cpu_in_sysfs_list(a, "topology/thread_siblings_list", b))
+        return PLACE_SMT;
+    for (int i = 0; i < 16; i++)
     {
-        a[t] = 0xaa;
+        int level = 0;
+        FILE *f;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/level", a, i);
+        if (!(f = fopen(path, "r")))
+            break;
+        if (fscanf(f, "%d", &level) != 1)
+            level = 0;
+        fclose(f);
+        snprintf(path, sizeof(path), "cache/index%d/shared_cpu_list", i);
+        if (level == 3 && cpu_in_sysfs_list(a, path, b))
+            return PLACE_L3;
     }
-    return a;
+    if (cpu_in_sysfs_list(a, "topology/package_cpus_list", b) ||
+        cpu_in_sysfs_list(a, "topology/core_siblings_list", b))
+        return PLACE_SOCKET;
+    return PLACE_REMOTE;
 }
 
-/* actual benchmark */
-/* asize: number of type 'long' elements in test arrays
- * long_size: sizeof(long) cached
- * type: 0=use memcpy, 1=use dumb copy loop (whatever GCC thinks best)
- *
- * return value: elapsed time in seconds
- */
-double worker(unsigned long long asize, long *a, long *b, int type, unsigned long long block_size, int repeats)
+/* the ring's indices each on lines of their own, the messages follow */
+struct spsc_ring
 {
-    unsigned long long t;
-    struct timeval starttime, endtime;
-    double te;
-    unsigned int long_size = sizeof(long);
-    /* array size in bytes */
-    unsigned long long array_bytes = asize * long_size;
+    unsigned long head __attribute__((aligned(128))); /* messages written, producer only */
+    unsigned long tail __attribute__((aligned(128))); /* messages read, consumer only */
+    struct barrier bar __attribute__((aligned(128))); /* start of each sample */
+    char data[] __attribute__((aligned(128)));
+};
 
-    gettimeofday(&starttime, NULL);
-    for (int rep = 0; rep < repeats; rep++)
+/* one side of the ring, forked and pinned to 'cpu': nr_loops samples of
+ * 'messages' messages each; the consumer stores how long each took */
+void spsc_side(struct spsc_ring *ring, int producer, int cpu, int same_cpu, size_t msg, unsigned long nr_slots,
+               unsigned long messages, int nr_loops, volatile double *times)
+{
+    /* the same cpu twice in -f: spinning only burns the time slice */
+    long spins = same_cpu ? 1 : SPIN_WAIT_LOOPS;
+    unsigned long mine = 0, theirs = 0;
+    char *buf = aligned_alloc(64, msg + 64);
+    cpu_set_t set;
+    int sense = 0;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+    memset(buf, producer ? 0xaa : 0x55, msg);
+    for (int i = 0; i < nr_loops; i++)
     {
-        if (type == TEST_MEMCPY)
-        { /* memcpy test */
-            memcpy(b, a, array_bytes);
-        }
-        else if (type == TEST_MCBLOCK)
-        { /* memcpy block test */
-            char *aa = (char *)a;
-            char *bb = (char *)b;
-            for (t = array_bytes; t >= block_size; t -= block_size, aa += block_size)
+        unsigned long end = mine + messages;
+        barrier_wait(&ring->bar, &sense);
+        double starttime = timestamp();
+        for (; mine < end; mine++)
+        {
+            char *slot = ring->data + (mine % nr_slots) * msg;
+            /* wait for a free slot, or for a message */
+            for (long s = 1; producer ? mine - theirs == nr_slots : mine == theirs; s++)
             {
-                bb = mempcpy(bb, aa, block_size);
+                theirs = __atomic_load_n(producer ? &ring->tail : &ring->head, __ATOMIC_ACQUIRE);
+                if (s % spins == 0)
+                    sched_yield();
+                else
+                    cpu_relax();
             }
-            if (t)
+            if (producer)
             {
-                bb = mempcpy(bb, aa, t);
+                memcpy(slot, buf, msg);
+                __atomic_store_n(&ring->head, mine + 1, __ATOMIC_RELEASE);
             }
-        }
-        else if (type == TEST_DUMB)
-        { /* dumb test */
-            volatile long *va = a, *vb = b;
-            for (t = 0; t < asize; t++)
+            else
             {
-                vb[t] = va[t];
+                memcpy(buf, slot, msg);
+                __atomic_store_n(&ring->tail, mine + 1, __ATOMIC_RELEASE);
             }
         }
+        if (!producer)
+            times[i] = timestamp() - starttime;
     }
-    gettimeofday(&endtime, NULL);
-
-    te = ((double)(endtime.tv_sec * 1000000 - starttime.tv_sec * 1000000 + endtime.tv_usec - starttime.tv_usec)) / 1000000;
-
-    return te;
+    exit(0);
 }
 
-/* ------------------------------------------------------ */
-
-/* pretty print worker's output in human-readable terms */
-/* te: elapsed time in seconds
- * mt: amount of transferred data in MiB
- * type: see 'worker' above
- *
- * return value: -
- */
-void printout(double te, double mt, int type)
+/* median seconds for 'messages' messages of one configuration, NAN if
+ * the ring doesn't hold two of them */
+double spsc_run(struct spsc_ring *ring, int producer_cpu, int consumer_cpu, size_t msg, size_t ring_bytes,
+                unsigned long messages, int nr_loops, double *times)
 {
-    switch (type)
+    unsigned long nr_slots = ring_bytes / msg;
+    pid_t pids[2];
+    struct stats st;
+
+    if (nr_slots < 2)
+        return NAN;
+    ring->head = ring->tail = 0;
+    ring->bar.count = ring->bar.sense = 0;
+    ring->bar.nr_procs = 2;
+    fflush(stdout);
+    for (int p = 0; p < 2; p++)
     {
-    case TEST_MEMCPY:
-        printf("Method: MEMCPY\t");
-        break;
-    case TEST_DUMB:
-        printf("Method: DUMB\t");
-        break;
-    case TEST_MCBLOCK:
-        printf("Method: MCBLOCK\t");
-        break;
+        pids[p] = fork();
+        if (pids[p] < 0)
+        {
+            perror("error forking workers");
+            exit(1);
+        }
+        if (pids[p] == 0)
+            spsc_side(ring, p == 0, p == 0 ? producer_cpu : consumer_cpu, producer_cpu == consumer_cpu, msg,
+                      nr_slots, messages, nr_loops, times);
     }
-    printf("Elapsed: %.5f\t", te);
-    printf("MiB: %.5f\t", mt);
-    printf("Copy: %.3f MiB/s\n", mt / te);
-    return;
+    for (int p = 0; p < 2; p++)
+    {
+        int status;
+        waitpid(pids[p], &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status))
+        {
+            printf("A ring worker failed. Exiting...\n");
+            exit(1);
+        }
+    }
+    compute_stats(&st, times, nr_loops);
+    return st.median;
 }
 
-double gettimedelta(struct timeval starttime, struct timeval endtime)
+void spsc_rings(const unsigned long long *msgs, int nr_msgs, const unsigned long long *rings, int nr_rings,
+                const int *cpus, int nr_cpus, int nr_loops, int quiet)
 {
-    return ((double)(endtime.tv_sec * 1000000 - starttime.tv_sec * 1000000 + endtime.tv_usec - starttime.tv_usec)) / 1000000;
+    size_t max_ring = rings[nr_rings - 1];
+    struct spsc_ring *ring = mmap(NULL, sizeof(*ring) + max_ring, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    double *times = mmap(NULL, sizeof(double) * nr_loops, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    /* median seconds per message: [consumer][msg][ring] */
+    double *sec = malloc(sizeof(double) * nr_cpus * nr_msgs * nr_rings);
+    char buf[32];
+#define SEC(c, m, r) sec[((c) * nr_msgs + (m)) * nr_rings + (r)]
+
+    if (ring == MAP_FAILED || times == MAP_FAILED)
+    {
+        perror("can't map the ring");
+        exit(1);
+    }
+    memset(ring->data, 0, max_ring);
+    for (int c = 1; c < nr_cpus; c++)
+    {
+        for (int m = 0; m < nr_msgs; m++)
+        {
+            unsigned long messages = SPSC_TARGET_BYTES / msgs[m];
+            if (messages < SPSC_MIN_MESSAGES)
+                messages = SPSC_MIN_MESSAGES;
+            for (int r = 0; r < nr_rings; r++)
+                SEC(c, m, r) = spsc_run(ring, cpus[0], cpus[c], msgs[m], rings[r], messages, nr_loops, times) /
+                               messages;
+        }
+        if (!quiet)
+        {
+            printf("cpu %d -> %d done\n", cpus[0], cpus[c]);
+            fflush(stdout);
+        }
+    }
+
+    for (int c = 1; c < nr_cpus; c++)
+    {
+        printf("\nRing from cpu %d to cpu %d (%s), median Mmsg/s and GiB/s by message and ring size:\n", cpus[0],
+               cpus[c], place_names[cpu_placement(cpus[0], cpus[c])]);
+        printf("%8s", "message");
+        for (int r = 0; r < nr_rings; r++)
+            printf(" %17s", format_size(buf, rings[r]));
+        printf("\n");
+        for (int m = 0; m < nr_msgs; m++)
+        {
+            printf("%8s", format_size(buf, msgs[m]));
+            for (int r = 0; r < nr_rings; r++)
+            {
+                if (isnan(SEC(c, m, r)))
+                    printf(" %17s", "-");
+                else
+                    printf(" %8.3lf %8.3lf", 1e-6 / SEC(c, m, r), msgs[m] / SEC(c, m, r) / (1 << 30));
+            }
+            printf("\n");
+        }
+    }
+
+    /* the placements side by side, each with its best ring size */
+    printf("\nBy placement (best ring size each):\n");
+    printf("%-20s %-12s", "cpus", "placement");
+    for (int m = 0; m < nr_msgs; m++)
+        printf(" %17s", format_size(buf, msgs[m]));
+    printf("\n");
+    for (int c = 1; c < nr_cpus; c++)
+    {
+        char pair[32];
+        snprintf(pair, sizeof(pair), "%d -> %d", cpus[0], cpus[c]);
+        printf("%-20s %-12s", pair, place_names[cpu_placement(cpus[0], cpus[c])]);
+        for (int m = 0; m < nr_msgs; m++)
+        {
+            double best = NAN;
+            for (int r = 0; r < nr_rings; r++)
+                if (!isnan(SEC(c, m, r)) && (isnan(best) || SEC(c, m, r) < best))
+                    best = SEC(c, m, r);
+            if (isnan(best))
+                printf(" %17s", "-");
+            else
+                printf(" %8.3lf %8.3lf", 1e-6 / best, msgs[m] / best / (1 << 30));
+        }
+        printf("\n");
+    }
+#undef SEC
+    free(sec);
+    munmap(times, sizeof(double) * nr_loops);
+    munmap(ring, sizeof(*ring) + max_ring);
 }
 
-int parse_cpu_affinity_str(int *cpu_pinno, const char *cpu_pinstr)
+/* ------------------------------------------------------ */
+
+/* NUMA matrix: the selected tests for every pair of (node we run on,
+ * node the arrays are bound to). A single process, pinned to all cpus
+ * of the cpu node in turn. Nodes without cpus or without memory show
+ * up as '-'. */
+void numa_matrix(const int *sel, int nr_tests, unsigned long long asize, unsigned long long block_size,
+                 int backend, int nr_loops, int nr_repeats, double mt, int quiet)
 {
-    int *pcpu_pinno = cpu_pinno;
-    const char *p = cpu_pinstr;
-    int start = -1, end = -1, step = -1;
-    while (*p)
+    int nodes[MAX_NUMA_NODES];
+    int nr_nodes = numa_online_nodes(nodes, MAX_NUMA_NODES);
+    int nr_arrays = 1;
+    /* median app bandwidth: [test][cpu node][memory node], NAN if not measured */
+    double *bw = malloc(sizeof(double) * nr_tests * nr_nodes * nr_nodes);
+    double *speeds = malloc(sizeof(double) * nr_loops);
+    cpu_set_t all;
+#define BW(k, c, m) bw[((k) * nr_nodes + (c)) * nr_nodes + (m)]
+
+    for (int k = 0; k < nr_tests; k++)
+        if (kernels[sel[k]].nr_arrays > nr_arrays)
+            nr_arrays = kernels[sel[k]].nr_arrays;
+    for (int i = 0; i < nr_tests * nr_nodes * nr_nodes; i++)
+        bw[i] = NAN;
+    if (nr_nodes == 1)
+        printf("Only one NUMA node, the matrix has a single entry.\n");
+
+    sched_getaffinity(0, sizeof(all), &all);
+    for (int c = 0; c < nr_nodes; c++)
     {
-        int t = 0;
-        while (isdigit(*p))
+        cpu_set_t set;
+        if (numa_node_cpus(nodes[c], &set) == 0 || sched_setaffinity(0, sizeof(set), &set))
         {
-            t = t * 10 + (*p - '0');
-            p++;
+            if (!quiet)
+                printf("Node %d has no cpus we can run on, skipping it.\n", nodes[c]);
+            continue;
         }
-        if (*p == ':' || *p == ',' || *p == '\0')
+        for (int m = 0; m < nr_nodes; m++)
         {
-            if (start == -1)
+            long *arr[3] = {NULL, NULL, NULL};
+            int ok = 1;
+            for (int i = 0; i < nr_arrays && ok; i++)
+                ok = (arr[i] = make_array(asize, nodes[m], backend)) != NULL;
+            if (ok)
             {
-                start = t;
+                struct kernel_args ka = {
+                    .a = arr[0],
+                    .b = arr[1],
+                    .c = arr[2],
+                    .asize = asize,
+                    .array_bytes = asize * sizeof(long),
+                    .block_size = block_size,
+                };
+                for (int k = 0; k < nr_tests; k++)
+                {
+                    const struct kernel *kn = &kernels[sel[k]];
+                    struct stats st;
+                    for (int i = 0; i < nr_loops; i++)
+                        speeds[i] = mt * nr_repeats * kernel_app_arrays(kn) / worker(kn, &ka, nr_repeats);
+                    compute_stats(&st, speeds, nr_loops);
+                    BW(k, c, m) = st.median;
+                }
+                if (!quiet)
+                {
+                    printf("cpu node %d, memory node %d done\n", nodes[c], nodes[m]);
+                    fflush(stdout);
+                }
             }
-            else if (end == -1)
+            for (int i = 0; i < nr_arrays; i++)
+                if (arr[i])
+                    free_array(arr[i], asize, nodes[m], backend);
+        }
+    }
+    sched_setaffinity(0, sizeof(all), &all);
+
+    for (int k = 0; k < nr_tests; k++)
+    {
+        char name[32];
+        printf("\nNUMA matrix of %s (median app MiB/s; rows: cpu node, columns: memory node):\n", kernels[sel[k]].name);
+        printf("%8s", "");
+        for (int m = 0; m < nr_nodes; m++)
+        {
+            snprintf(name, sizeof(name), "node %d", nodes[m]);
+            printf(" %12s", name);
+        }
+        printf("\n");
+        for (int c = 0; c < nr_nodes; c++)
+        {
+            snprintf(name, sizeof(name), "node %d", nodes[c]);
+            printf("%8s", name);
+            for (int m = 0; m < nr_nodes; m++)
             {
-                end = t;
+                if (isnan(BW(k, c, m)))
+                    printf(" %12s", "-");
+                else
+                    printf(" %12.2lf", BW(k, c, m));
             }
-            else if (step == -1)
+            printf("\n");
+        }
+    }
+#undef BW
+    free(speeds);
+    free(bw);
+}
+
+/* ------------------------------------------------------ */
+
+/* option validation: the modes and options that change what is run */
+#define MODE_ENDLESS (1 << 0)   /* -n 0 */
+#define MODE_LATENCY (1 << 1)
+#define MODE_LOADED (1 << 2)
+#define MODE_SWEEP (1 << 3)
+#define MODE_SCALING (1 << 4)
+#define MODE_SYNC (1 << 5)
+#define MODE_FAULTS (1 << 6)
+#define MODE_NUMA (1 << 7)
+#define MODE_SHARED (1 << 8)
+#define MODE_COLD (1 << 9)
+#define MODE_BLOCKS (1 << 10)   /* -b sweep */
+#define MODE_PREFETCH (1 << 11) /* --prefetch-sweep */
+#define MODE_PERF (1 << 12)
+#define MODE_INDEX (1 << 13)    /* gather or scatter selected */
+#define MODE_OFFSET (1 << 14)   /* --src-offset, --dst-offset */
+#define MODE_OFFSETS (1 << 15)  /* --offset-sweep */
+#define MODE_SMALL (1 << 16)
+#define MODE_CONVERGE (1 << 17) /* --auto, --ci, --budget */
+#define MODE_OUTPUT (1 << 18)   /* --json, --csv, --baseline */
+#define MODE_C2C (1 << 19)
+#define MODE_SPSC (1 << 20)
+#define MODE_IPC (1 << 21)
+
+/* two modes can be combined if either of them allows the other; a new
+ * mode only needs its own entry, with what it works together with */
+struct mode
+{
+    int mode;
+    const char *name;
+    int allows;
+};
+
+const struct mode modes[] = {
+    {MODE_ENDLESS, "-n 0", MODE_LATENCY | MODE_COLD | MODE_INDEX | MODE_OFFSET | MODE_CONVERGE},
+    {MODE_LATENCY, "--latency", MODE_LOADED | MODE_SWEEP},
+    {MODE_LOADED, "--loaded", 0},
+    {MODE_SWEEP, "--sweep", MODE_COLD | MODE_OFFSET},
+    {MODE_SCALING, "--scaling", MODE_COLD | MODE_INDEX | MODE_OFFSET},
+    {MODE_SYNC, "--sync", MODE_COLD | MODE_PERF | MODE_INDEX | MODE_OFFSET | MODE_CONVERGE | MODE_OUTPUT},
+    {MODE_FAULTS, "--faults", 0},
+    {MODE_NUMA, "--numa-matrix", 0},
+    {MODE_SHARED, "--shared", MODE_OFFSET},
+    {MODE_COLD, "--cold", MODE_BLOCKS | MODE_PREFETCH | MODE_OFFSETS | MODE_PERF | MODE_INDEX | MODE_OFFSET |
+                              MODE_CONVERGE | MODE_OUTPUT},
+    {MODE_BLOCKS, "a -b sweep", MODE_OFFSET},
+    {MODE_PREFETCH, "--prefetch-sweep", MODE_OFFSET},
+    {MODE_PERF, "--perf", MODE_INDEX | MODE_OFFSET | MODE_CONVERGE | MODE_OUTPUT},
+    {MODE_INDEX, "gather and scatter", MODE_OFFSET | MODE_OFFSETS | MODE_CONVERGE | MODE_OUTPUT},
+    {MODE_OFFSET, "--src-offset and --dst-offset", MODE_CONVERGE | MODE_OUTPUT},
+    {MODE_OFFSETS, "--offset-sweep", 0},
+    {MODE_SMALL, "--small", 0},
+    {MODE_CONVERGE, "--auto, --ci and --budget", MODE_OUTPUT},
+    {MODE_OUTPUT, "--json, --csv and --baseline", 0},
+    {MODE_C2C, "--c2c", 0},
+    {MODE_SPSC, "--spsc", 0},
+    {MODE_IPC, "--ipc", 0},
+};
+
+#define NR_MODES ((int)(sizeof(modes) / sizeof(modes[0])))
+
+/* can all the modes in 'set' run together? Says which two can't.
+ *
+ * return value: 0 if they can, -1 if not
+ */
+int check_modes(int set)
+{
+    for (int i = 0; i < NR_MODES; i++)
+    {
+        if (!(set & modes[i].mode))
+            continue;
+        for (int j = i + 1; j < NR_MODES; j++)
+        {
+            if ((set & modes[j].mode) && !(modes[i].allows & modes[j].mode) && !(modes[j].allows & modes[i].mode))
             {
-                step = end;
-                end = t;
-            }
-            else
+                printf("Error: can't combine %s with %s!\n", modes[i].name, modes[j].name);
                 return -1;
-            if (*p != ':')
-            {
-                for (int i = start; i <= end; i += (step >= 1 ? step : 1))
-                    *(++pcpu_pinno) = i;
-                start = end = step = -1;
             }
-            if (!*p)
-                break;
-            p++;
-        }
-        else
-        {
-            return -1;
         }
     }
-    return pcpu_pinno - cpu_pinno;
+    return 0;
 }
 
 /* ------------------------------------------------------ */
@@ -252,12 +5342,13 @@ int main(int argc, char **argv)
     int nr_procs = 1;
     int nr_repeats = 3;
     unsigned int long_size = 0;
-    double te, te_sum;            /* time elapsed */
     unsigned long long asize = 0; /* array size (elements in array) */
-    int i;
-    long *a, *b; /* the two arrays to be copied from/to */
-    int o;       /* getopt options */
-    unsigned long testno;
+    long *a, *b = NULL; /* the two arrays to be copied from/to */
+    long *c = NULL;     /* third array for the add and triad tests */
+    char *evict = NULL; /* --cold=evict buffer */
+    unsigned int *idx = NULL; /* index array of gather and scatter */
+    int nr_arrays = 2;
+    int o;              /* getopt options */
     char *cpu_pinstr = NULL;
     int cpu_pinno[PROCMAP_SIZE];
 
@@ -265,22 +5356,127 @@ int main(int argc, char **argv)
 
     /* how many runs to average? */
     int nr_loops = DEFAULT_NR_LOOPS;
-    /* fixed memcpy block size for -t2 */
+    /* fixed memcpy block size for mcblock */
     unsigned long long block_size = DEFAULT_BLOCK_SIZE;
     /* show average, -a */
     int showavg = 1;
     /* what tests to run (-t x) */
-    int tests[MAX_TESTS];
+    int tests[NR_KERNELS];
+    int sel[NR_KERNELS]; /* kernel index of each selected test */
     double mt = 0; /* MiBytes transferred == array size in MiB */
     int quiet = 0; /* suppress extra messages */
+    /* chain stride for --latency, 0 to run the bandwidth tests */
+    unsigned int latency = 0;
+    /* --sweep: working sets of the sweep and of the latency test */
+    char *sweep_str = NULL;
+    /* --scaling: run the tests on growing subsets of the workers */
+    int scaling = 0;
+    /* --sync: lock-step iterations, needs a barrier and timestamps */
+    int sync = 0;
+    int histogram = 0; /* --histogram */
+    int use_tsc = 0;   /* --tsc */
+    /* --src-node/--dst-node: where the arrays live, -1 for first touch */
+    int src_node = -1, dst_node = -1;
+    int numa_matrix_mode = 0; /* --numa-matrix */
+    int backend = ALLOC_MALLOC; /* --alloc */
+    int fault_mode = 0;         /* --faults */
+    int cold = 0;               /* --cold: COLD_* */
+    int partition = -1;         /* --shared: SHARED_*, -1 for the forked workers */
+    const char *small_str = NULL; /* --small: the copy sizes */
+    const char *ipc_str = NULL;   /* --ipc: the message sizes */
+    int c2c = 0;                  /* --c2c */
+    double auto_ms = 0;           /* --auto: target sample duration, 0 for -r */
+    int *auto_repeats = NULL;     /* --auto: what worker 1 calibrated, shared */
+    struct convergence conv = {0, 0, NULL};
+    volatile int **mpcounts = NULL;
+    int loops_given = 0;
+    const char *json_path = NULL;     /* --json */
+    const char *csv_path = NULL;      /* --csv */
+    const char *baseline_path = NULL; /* --baseline */
+    double threshold = BASELINE_DEFAULT_THRESHOLD;
+    const char *spsc_str = NULL;  /* --spsc: the message sizes */
+    const char *spsc_ring_str = SPSC_DEFAULT_RINGS; /* --spsc-ring: the ring sizes */
+    /* -b with a sweep: the block sizes of mcblock */
+    unsigned long long block_sizes[MAX_SIZES];
+    int nr_block_sizes = 0;
+    /* --src-offset/--dst-offset, -1 to leave the arrays where they are */
+    long src_offset = -1, dst_offset = -1;
+    /* --offset-sweep: the offsets of the grid */
+    const char *offset_str = NULL;
+    long offsets[MAX_OFFSETS];
+    int nr_offsets = 0;
+    int needs_index = 0; /* a selected test uses the index array */
+    int perf = 0;        /* --perf */
+    double interval = SOAK_DEFAULT_INTERVAL; /* -n 0: seconds between reports */
+    struct soak_ring **rings = NULL;
+    volatile double **mpcounters = NULL;
+    struct imc_counters imc;
+    /* --prefetch-sweep: the prefetch distances */
+    unsigned long long dists[MAX_SIZES];
+    int nr_dists = 0;
+    unsigned long long pad = 0; /* longs allocated beyond each array for the offsets */
+    struct barrier *bar = NULL;
+    volatile double **mpstamps = NULL;
+    unsigned long long sizes[MAX_SIZES];
+    int nr_sizes = 0;
+    unsigned long long array_bytes = 0;
+    int nr_cols = 0; /* columns per row of mpresults */
 
-    tests[0] = 0;
-    tests[1] = 0;
-    tests[2] = 0;
+    /* --loaded: the probes' cpus, NULL to run the other tests */
+    char *loaded_pinstr = NULL;
+    const char *delays_str = LOADED_DEFAULT_DELAYS;
+    struct loaded_config lc;
+
+    static const struct option long_options[] = {
+        {"latency", optional_argument, NULL, 'L'},
+        {"loaded", required_argument, NULL, 'O'},
+        {"sweep", required_argument, NULL, 'S'},
+        {"scaling", no_argument, NULL, 'C'},
+        {"sync", no_argument, NULL, 'Y'},
+        {"histogram", no_argument, NULL, 'H'},
+        {"tsc", no_argument, NULL, 'T'},
+        {"src-node", required_argument, NULL, 'A'},
+        {"dst-node", required_argument, NULL, 'B'},
+        {"numa-matrix", no_argument, NULL, 'M'},
+        {"alloc", required_argument, NULL, 'G'},
+        {"faults", no_argument, NULL, 'F'},
+        {"cold", optional_argument, NULL, 'K'},
+        {"shared", optional_argument, NULL, 'W'},
+        {"small", optional_argument, NULL, 'm'},
+        {"ipc", optional_argument, NULL, 'X'},
+        {"c2c", no_argument, NULL, 'c'},
+        {"auto", optional_argument, NULL, 'Z'},
+        {"json", required_argument, NULL, 'j'},
+        {"csv", required_argument, NULL, 'x'},
+        {"baseline", required_argument, NULL, 'g'},
+        {"threshold", required_argument, NULL, 'y'},
+        {"ci", required_argument, NULL, 'J'},
+        {"budget", required_argument, NULL, 'N'},
+        {"spsc", optional_argument, NULL, 'U'},
+        {"spsc-ring", required_argument, NULL, 'V'},
+        {"src-offset", required_argument, NULL, 's'},
+        {"dst-offset", required_argument, NULL, 'd'},
+        {"offset-sweep", optional_argument, NULL, 'o'},
+        {"stride", required_argument, NULL, 'e'},
+        {"index", required_argument, NULL, 'i'},
+        {"prefetch", required_argument, NULL, 'P'},
+        {"perf", no_argument, NULL, 'E'},
+        {"prefetch-sweep", optional_argument, NULL, 'Q'},
+        {"delays", required_argument, NULL, 'D'},
+        {"interval", required_argument, NULL, 'I'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int nr_tests = 0; /* how many tests selected */
+    int mcblock = find_kernel("mcblock");
+
+    memset(tests, 0, sizeof(tests));
+    detect_cpu_features();
 
     memset(cpu_pinno, 0, sizeof(cpu_pinno));
 
-    while ((o = getopt(argc, argv, "haqn:t:b:p:r:f:")) != EOF)
+    while ((o = getopt_long(argc, argv, "haqn:t:b:p:r:f:", long_options, NULL)) != EOF)
     {
         switch (o)
         {
@@ -293,18 +5489,38 @@ int main(int argc, char **argv)
             break;
         case 'n': /* no. loops */
             nr_loops = strtoul(optarg, (char **)NULL, 10);
+            loops_given = 1;
             break;
-        case 't': /* test to run */
-            testno = strtoul(optarg, (char **)NULL, 10);
-            if (testno > MAX_TESTS - 1)
+        case 't': /* tests to run */
+            for (char *name = strtok(optarg, ","); name; name = strtok(NULL, ","))
             {
-                printf("Error: test number must be between 0 and %d\n", MAX_TESTS - 1);
-                exit(1);
+                int k = find_kernel(name);
+                if (k < 0)
+                {
+                    printf("Error: unknown test '%s', see -h for the list\n", name);
+                    exit(1);
+                }
+                if (!kernel_supported(&kernels[k]))
+                {
+                    printf("Error: test %s is not supported on this CPU\n", kernels[k].name);
+                    exit(1);
+                }
+                tests[k] = 1;
             }
-            tests[testno] = 1;
             break;
-        case 'b': /* block size in bytes*/
-            block_size = strtoull(optarg, (char **)NULL, 10);
+        case 'b': /* block size in bytes, or a sweep of them */
+            if (strchr(optarg, ':'))
+            {
+                nr_block_sizes = parse_sweep(block_sizes, optarg, 1);
+                if (nr_block_sizes < 0)
+                {
+                    printf("Error: block size sweep must look like 4K:1M:x2 or 64K:1M:+64K\n");
+                    exit(1);
+                }
+                block_size = block_sizes[nr_block_sizes - 1];
+                break;
+            }
+            block_size = parse_size(optarg, 1);
             if (0 >= block_size)
             {
                 printf("Error: what block size do you mean?\n");
@@ -320,9 +5536,245 @@ int main(int argc, char **argv)
         case 'r': /* no. repeats */
             nr_repeats = strtoul(optarg, (char **)NULL, 10);
             break;
-        case 'f': /* cpu affinity string */
-            cpu_pinstr = (char *)malloc(strlen(optarg) + 2);
-            strcpy(cpu_pinstr, optarg);
+        case 'f': /* cpu affinity string */
+            cpu_pinstr = (char *)malloc(strlen(optarg) + 2);
+            strcpy(cpu_pinstr, optarg);
+            break;
+        case 'L': /* pointer-chasing latency test */
+            if (!optarg || !strcmp(optarg, "line"))
+                latency = LATENCY_LINE;
+            else if (!strcmp(optarg, "page"))
+                latency = LATENCY_PAGE;
+            else
+            {
+                printf("Error: latency granularity must be 'line' or 'page'\n");
+                exit(1);
+            }
+            break;
+        case 'O': /* loaded latency, probe cpus */
+            loaded_pinstr = optarg;
+            break;
+        case 'D': /* loaded latency injection delays */
+            delays_str = optarg;
+            break;
+        case 'I': /* soak reporting interval */
+            interval = strtod(optarg, NULL);
+            if (!(interval > 0))
+            {
+                printf("Error: --interval must be a positive number of seconds!\n");
+                exit(1);
+            }
+            break;
+        case 'C': /* worker count and pinning sweep */
+            scaling = 1;
+            break;
+        case 'Y': /* lock-step iterations */
+            sync = 1;
+            break;
+        case 'H': /* sample histograms */
+            histogram = 1;
+            break;
+        case 'T': /* time with the TSC */
+            use_tsc = 1;
+            break;
+        case 'A': /* NUMA node of the source array */
+        case 'B': /* NUMA node of the destination arrays */
+        {
+            char *end;
+            long node = strtol(optarg, &end, 10);
+            if (end == optarg || *end || !numa_node_online(node))
+            {
+                printf("Error: '%s' is not an online NUMA node\n", optarg);
+                exit(1);
+            }
+            if (o == 'A')
+                src_node = node;
+            else
+                dst_node = node;
+            break;
+        }
+        case 'M': /* node to node bandwidth matrix */
+            numa_matrix_mode = 1;
+            break;
+        case 'F': /* page fault throughput */
+            fault_mode = 1;
+            break;
+        case 'K': /* cold caches before every pass */
+#ifdef HAVE_X86
+            if (!optarg || !strcmp(optarg, "clflush"))
+                cold = COLD_CLFLUSH;
+            else
+#endif
+            if (!optarg || !strcmp(optarg, "evict"))
+                cold = COLD_EVICT;
+            else
+            {
+                printf("Error: --cold takes clflush (x86 only) or evict\n");
+                exit(1);
+            }
+            break;
+        case 's': /* source array offset */
+        case 'd': /* destination array offset */
+        {
+            char *end;
+            long off = strtol(optarg, &end, 10);
+            if (end == optarg || *end || off < 0)
+            {
+                printf("Error: offsets are a number of bytes\n");
+                exit(1);
+            }
+            if (o == 's')
+                src_offset = off;
+            else
+                dst_offset = off;
+            break;
+        }
+        case 'o': /* src x dst offset grid */
+            offset_str = optarg ? optarg : OFFSET_DEFAULT_SWEEP;
+            nr_offsets = parse_offsets(offsets, MAX_OFFSETS, offset_str);
+            if (nr_offsets <= 0)
+            {
+                printf("Error: --offset-sweep takes up to %d comma separated offsets in bytes\n", MAX_OFFSETS);
+                exit(1);
+            }
+            break;
+        case 'e': /* stride of the access pattern tests */
+            access_stride = parse_size(optarg, 1);
+            if (access_stride < sizeof(long) || access_stride % sizeof(long))
+            {
+                printf("Error: the stride must be a multiple of %d bytes\n", (int)sizeof(long));
+                exit(1);
+            }
+            break;
+        case 'i': /* index order of gather and scatter */
+            for (index_pattern = 0; index_pattern < 3 && strcmp(optarg, index_names[index_pattern]); index_pattern++)
+                ;
+            if (index_pattern == 3)
+            {
+                printf("Error: --index must be seq, stride or random\n");
+                exit(1);
+            }
+            break;
+        case 'E': /* hardware counters */
+            perf = 1;
+            break;
+        case 'P': /* prefetch distance and hint */
+        {
+            char *end = strchr(optarg, ',');
+            /* the distance alone, parse_size() gives up on the comma */
+            if (end)
+                *end = '\0';
+            prefetch_distance = parse_size(optarg, 1);
+            if (end)
+            {
+                for (prefetch_hint = 3; prefetch_hint >= 0 && strcmp(end + 1, prefetch_hints[prefetch_hint]); prefetch_hint--)
+                    ;
+            }
+            if (!prefetch_distance || prefetch_hint < 0)
+            {
+                printf("Error: --prefetch takes a distance in bytes and optionally a hint: nta, t2, t1 or t0\n");
+                exit(1);
+            }
+            break;
+        }
+        case 'Q': /* prefetch distance sweep */
+            nr_dists = parse_sweep(dists, optarg ? optarg : PREFETCH_DEFAULT_SWEEP, 1);
+            if (nr_dists < 0)
+            {
+                printf("Error: prefetch sweep must look like 64:16K:x2 or 64:1K:+64\n");
+                exit(1);
+            }
+            break;
+        case 'm': /* small copies */
+            small_str = optarg ? optarg : SMALL_DEFAULT_SIZES;
+            break;
+        case 'U': /* producer/consumer rings */
+            spsc_str = optarg ? optarg : SPSC_DEFAULT_MSGS;
+            break;
+        case 'V': /* producer/consumer ring sizes */
+            spsc_ring_str = optarg;
+            break;
+        case 'j': /* JSON results */
+            json_path = optarg;
+            break;
+        case 'x': /* CSV results */
+            csv_path = optarg;
+            break;
+        case 'g': /* compare with an earlier run */
+            baseline_path = optarg;
+            break;
+        case 'y': /* regression threshold */
+            threshold = strtod(optarg, NULL);
+            if (!(threshold >= 0))
+            {
+                printf("Error: --threshold must be a percentage!\n");
+                exit(1);
+            }
+            break;
+        case 'Z': /* calibrate the repeats */
+            auto_ms = optarg ? strtod(optarg, NULL) : AUTO_DEFAULT_MS;
+            if (!(auto_ms > 0))
+            {
+                printf("Error: --auto needs a positive number of milliseconds!\n");
+                exit(1);
+            }
+            break;
+        case 'J': /* stop at a confidence interval */
+        {
+            char *end;
+            conv.ci = strtod(optarg, &end);
+            if (*end == '%')
+                conv.ci /= 100;
+            if (!(conv.ci > 0))
+            {
+                printf("Error: --ci needs a positive relative width like 0.01 or 1%%!\n");
+                exit(1);
+            }
+            break;
+        }
+        case 'N': /* time budget per test */
+            conv.budget = strtod(optarg, NULL);
+            if (!(conv.budget > 0))
+            {
+                printf("Error: --budget must be a positive number of seconds!\n");
+                exit(1);
+            }
+            break;
+        case 'c': /* core to core latency */
+            c2c = 1;
+            break;
+        case 'X': /* cross-process copies */
+            ipc_str = optarg ? optarg : IPC_DEFAULT_SIZES;
+            break;
+        case 'W': /* threads on shared arrays */
+            if (!optarg || !strcmp(optarg, "static"))
+                partition = SHARED_STATIC;
+            else if (!strcmp(optarg, "interleave"))
+                partition = SHARED_INTERLEAVE;
+            else if (!strcmp(optarg, "steal"))
+                partition = SHARED_STEAL;
+            else
+            {
+                printf("Error: --shared partitioning must be static, interleave or steal\n");
+                exit(1);
+            }
+            break;
+        case 'G': /* allocation backend */
+            backend = parse_alloc(optarg);
+            if (backend < 0)
+            {
+                printf("Error: unknown allocation backend '%s', see -h for the list\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'S': /* working set sweep */
+            sweep_str = optarg;
+            nr_sizes = parse_sweep(sizes, sweep_str, sizeof(long));
+            if (nr_sizes < 0)
+            {
+                printf("Error: sweep must look like 4K:1G:x2 or 1M:64M:+1M\n");
+                exit(1);
+            }
             break;
         default:
             break;
@@ -353,22 +5805,239 @@ int main(int argc, char **argv)
     }
 
     /* default is to run all tests if no specific tests were requested */
-    if ((tests[0] + tests[1] + tests[2]) == 0)
+    for (int k = 0; k < NR_KERNELS; k++)
+        nr_tests += tests[k];
+    if (nr_tests == 0 && nr_block_sizes)
+        tests[mcblock] = 1;
+    else if (nr_tests == 0 && nr_dists)
+    {
+        tests[find_kernel("pf_read")] = 1;
+        tests[find_kernel("pf_copy")] = 1;
+        tests[find_kernel("pf_stride")] = 1;
+    }
+    else if (nr_tests == 0 && small_str)
+    {
+        for (int k = 0; k < NR_KERNELS; k++)
+            tests[k] = kernel_supported(&kernels[k]) && small_copy_fn(&kernels[k]) && kernels[k].write_allocate;
+    }
+    else if (nr_tests == 0 && numa_matrix_mode)
+    {
+        tests[find_kernel("memcpy")] = 1;
+        tests[find_kernel("read")] = 1;
+    }
+    else if (nr_tests == 0)
+    {
+        for (int k = 0; k < NR_KERNELS; k++)
+            tests[k] = kernel_supported(&kernels[k]) && !kernels[k].on_request;
+    }
+    nr_tests = 0;
+    for (int k = 0; k < NR_KERNELS; k++)
+    {
+        if (!tests[k])
+            continue;
+        sel[nr_tests++] = k;
+        needs_index |= kernels[k].needs_index;
+        if (kernels[k].nr_arrays > nr_arrays)
+            nr_arrays = kernels[k].nr_arrays;
+    }
+
+    {
+        int set = (nr_loops == 0 ? MODE_ENDLESS : 0) | (latency ? MODE_LATENCY : 0) |
+                  (loaded_pinstr ? MODE_LOADED : 0) | (sweep_str ? MODE_SWEEP : 0) | (scaling ? MODE_SCALING : 0) |
+                  (sync ? MODE_SYNC : 0) | (fault_mode ? MODE_FAULTS : 0) | (numa_matrix_mode ? MODE_NUMA : 0) |
+                  (partition >= 0 ? MODE_SHARED : 0) | (cold ? MODE_COLD : 0) | (nr_block_sizes ? MODE_BLOCKS : 0) |
+                  (nr_dists ? MODE_PREFETCH : 0) | (perf ? MODE_PERF : 0) | (needs_index ? MODE_INDEX : 0) |
+                  (src_offset >= 0 || dst_offset >= 0 ? MODE_OFFSET : 0) | (nr_offsets ? MODE_OFFSETS : 0) |
+                  (small_str ? MODE_SMALL : 0) | (auto_ms || conv.ci || conv.budget ? MODE_CONVERGE : 0) |
+                  (json_path || csv_path || baseline_path ? MODE_OUTPUT : 0) | (c2c ? MODE_C2C : 0) |
+                  (spsc_str ? MODE_SPSC : 0) | (ipc_str ? MODE_IPC : 0);
+        if (check_modes(set) < 0)
+            exit(1);
+    }
+
+    if (loaded_pinstr)
     {
-        tests[0] = 1;
-        tests[1] = 1;
-        tests[2] = 1;
+        static int probe_cpus[PROCMAP_SIZE];
+        static long delays[64];
+        int nr_probe_cpus = parse_cpu_affinity_str(probe_cpus, loaded_pinstr);
+        int nr_probes = 0;
+        if (nr_probe_cpus <= 0)
+        {
+            printf("Error: can't parse the --loaded cpu list\n");
+            exit(1);
+        }
+        lc.is_probe = calloc(nr_procs + 1, sizeof(int));
+        for (int i = 1; i <= nr_procs; i++)
+        {
+            for (int j = 1; j <= nr_probe_cpus; j++)
+                lc.is_probe[i] |= cpu_pinno[i] == probe_cpus[j];
+            nr_probes += lc.is_probe[i];
+        }
+        if (nr_probes == 0 || nr_probes == nr_procs)
+        {
+            printf("Error: loaded latency needs both probe and hog workers, %d of %d workers are probes\n", nr_probes, nr_procs);
+            exit(1);
+        }
+        lc.nr_levels = parse_delays(delays, 64, delays_str);
+        if (lc.nr_levels < 0)
+        {
+            printf("Error: can't parse the --delays list\n");
+            exit(1);
+        }
+        lc.delays = delays;
+        lc.hog = &kernels[sel[0]];
+        if (block_size < sizeof(long) || block_size % sizeof(long))
+        {
+            printf("Error: loaded latency needs a -b block size that is a multiple of %zu bytes\n", sizeof(long));
+            exit(1);
+        }
+        lc.chunk_bytes = block_size;
+        lc.stride = latency ? latency : LATENCY_LINE;
+        nr_arrays = lc.hog->nr_arrays;
+        if (nr_arrays < 2)
+            nr_arrays = 2;
     }
+    else if (latency)
+        nr_arrays = 1;
 
-    if (nr_loops == 0 && ((tests[0] + tests[1] + tests[2]) != 1))
+    if (nr_loops == 0 && nr_tests != 1 && !latency)
     {
         printf("Error: nr_loops can be zero if only one test selected!\n");
         exit(1);
     }
 
+    if (nr_block_sizes && (nr_tests != 1 || !tests[mcblock]))
+    {
+        printf("Error: a block size sweep only works with the mcblock test!\n");
+        exit(1);
+    }
+
+    if (nr_dists)
+    {
+        for (int k = 0; k < nr_tests; k++)
+        {
+            if (strncmp(kernels[sel[k]].name, "pf_", 3))
+            {
+                printf("Error: %s doesn't prefetch, --prefetch-sweep runs the pf_ tests\n", kernels[sel[k]].name);
+                exit(1);
+            }
+        }
+    }
+
+    if (src_offset >= 0 || dst_offset >= 0 || nr_offsets)
+    {
+        long max_offset = src_offset > dst_offset ? src_offset : dst_offset;
+        for (int i = 0; i < nr_offsets; i++)
+            max_offset = offsets[i] > max_offset ? offsets[i] : max_offset;
+        for (int k = 0; k < nr_tests; k++)
+        {
+            int misaligned = (src_offset > 0 && src_offset % sizeof(long)) || (dst_offset > 0 && dst_offset % sizeof(long));
+            for (int i = 0; i < nr_offsets; i++)
+                misaligned |= offsets[i] % sizeof(long) != 0;
+            if (misaligned && !kernel_bytewise(&kernels[sel[k]]))
+            {
+                printf("Error: %s works on longs, its offsets must be multiples of %d\n", kernels[sel[k]].name,
+                       (int)sizeof(long));
+                exit(1);
+            }
+        }
+        pad = offset_pad(max_offset);
+        if (src_offset < 0)
+            src_offset = 0;
+        if (dst_offset < 0)
+            dst_offset = 0;
+    }
+
+    if (small_str)
+    {
+        unsigned long long small_sizes[MAX_SIZES];
+        int nr_small_sizes = parse_sweep(small_sizes, small_str, 1);
+        if (nr_small_sizes < 0)
+        {
+            printf("Error: --small sizes must look like 1:64K:x2 or 8:256:+8\n");
+            exit(1);
+        }
+        for (int k = 0; k < nr_tests; k++)
+        {
+            if (!small_copy_fn(&kernels[sel[k]]))
+            {
+                printf("Error: %s is not a copy, --small can't run it\n", kernels[sel[k]].name);
+                exit(1);
+            }
+        }
+        if (!tsc_hz)
+            calibrate_tsc(TSC_CALIBRATE_MS);
+        small_copies(sel, nr_tests, small_sizes, nr_small_sizes, cpu_pinno[1], nr_loops, quiet);
+        return 0;
+    }
+
+    if (conv.ci || conv.budget)
+    {
+        if (sync || perf || (loops_given && nr_loops == 0))
+        {
+            printf("Error: --ci and --budget stop each worker on its own, not with --sync, --perf or -n 0!\n");
+            exit(1);
+        }
+        /* -n is the most samples then */
+        if (!loops_given)
+            nr_loops = CI_MAX_LOOPS;
+    }
+
+    if (c2c)
+    {
+        if (nr_procs < 2)
+        {
+            printf("Error: --c2c needs at least two cpus, see -p and -f!\n");
+            exit(1);
+        }
+        c2c_matrix(cpu_pinno + 1, nr_procs, nr_loops, quiet);
+        return 0;
+    }
+
+    if (spsc_str)
+    {
+        unsigned long long msgs[MAX_SIZES], rings[MAX_SIZES];
+        int nr_msgs = parse_sweep(msgs, spsc_str, 1);
+        int nr_rings = parse_sweep(rings, spsc_ring_str, 64);
+        if (nr_msgs < 0 || nr_rings < 0)
+        {
+            printf("Error: --spsc and --spsc-ring sizes must look like 64:64K:x8 or 64K:1M:+64K\n");
+            exit(1);
+        }
+        if (nr_procs < 2)
+        {
+            printf("Error: --spsc needs a producer and at least one consumer cpu, see -p and -f!\n");
+            exit(1);
+        }
+        spsc_rings(msgs, nr_msgs, rings, nr_rings, cpu_pinno + 1, nr_procs, nr_loops, quiet);
+        return 0;
+    }
+
+    if (ipc_str)
+    {
+        unsigned long long ipc_sizes[MAX_SIZES];
+        int nr_ipc_sizes = parse_sweep(ipc_sizes, ipc_str, sizeof(long));
+        if (nr_ipc_sizes < 0)
+        {
+            printf("Error: --ipc sizes must look like 4K:64M:x4 or 64K:1M:+64K\n");
+            exit(1);
+        }
+        if (nr_procs != 2)
+        {
+            printf("Error: --ipc needs -p 2, the receiver and the sender!\n");
+            exit(1);
+        }
+        ipc_copies(ipc_sizes, nr_ipc_sizes, cpu_pinno[1], cpu_pinno[2], nr_loops, quiet);
+        return 0;
+    }
+
     if (optind < argc)
     {
-        mt = strtoul(argv[optind++], (char **)NULL, 10);
+        array_bytes = parse_size(argv[optind++], 1024 * 1024);
+    }
+    else if (sweep_str)
+    {
+        array_bytes = sizes[nr_sizes - 1];
     }
     else
     {
@@ -376,7 +6045,7 @@ int main(int argc, char **argv)
         exit(1);
     }
 
-    if (0 >= mt)
+    if (0 >= array_bytes)
     {
         printf("Error: array size wrong!\n");
         exit(1);
@@ -384,8 +6053,47 @@ int main(int argc, char **argv)
 
     /* ------------------------------------------------------ */
 
-    long_size = sizeof(long);             /* the size of long on this platform */
-    asize = 1024 * 1024 / long_size * mt; /* how many longs then in one array? */
+    long_size = sizeof(long);          /* the size of long on this platform */
+    asize = array_bytes / long_size;   /* how many longs then in one array? */
+    mt = (double)array_bytes / 1024 / 1024;
+
+    if (sweep_str && sizes[nr_sizes - 1] > asize * long_size)
+    {
+        printf("Error: the sweep goes beyond the array size!\n");
+        exit(1);
+    }
+
+    if (latency && !loaded_pinstr && !sweep_str)
+    {
+        if (asize * long_size < LATENCY_MIN_SIZE)
+        {
+            printf("Error: array size smaller than the smallest latency working set (%d bytes)!\n", LATENCY_MIN_SIZE);
+            exit(1);
+        }
+        nr_sizes = make_sizes(sizes, LATENCY_MIN_SIZE, asize * long_size, 2, 0, sizeof(long));
+    }
+    if (fault_mode)
+        nr_cols = 2 * NR_FAULT_TESTS;
+    else if (nr_offsets)
+        nr_cols = nr_offsets * nr_offsets * nr_tests;
+    else if (nr_block_sizes)
+        nr_cols = nr_block_sizes;
+    else if (nr_dists)
+        nr_cols = (nr_dists + 1) * nr_tests;
+    else if (loaded_pinstr)
+        nr_cols = lc.nr_levels;
+    else if (latency)
+        nr_cols = nr_sizes;
+    else if (sweep_str)
+        nr_cols = nr_sizes * nr_tests;
+    else
+        nr_cols = nr_tests;
+
+    if (needs_index && asize > UINT_MAX)
+    {
+        printf("Error: gather and scatter index at most %u longs!\n", UINT_MAX);
+        exit(1);
+    }
 
     if (asize * long_size < block_size)
     {
@@ -396,33 +6104,139 @@ int main(int argc, char **argv)
     if (!quiet)
     {
         printf("Long uses %d bytes. ", long_size);
-        printf("Allocating 2*%lld elements = %lld bytes of memory.\n", asize, 2 * asize * long_size);
-        if (tests[2])
+        printf("Allocating %d*%lld elements = %lld bytes of memory.\n", nr_arrays, asize, nr_arrays * asize * long_size);
+        if (tests[mcblock] && !latency)
         {
             printf("Using %lld bytes as blocks for memcpy block copy test.\n", block_size);
         }
+        printf("CPU features: sse2=%d erms=%d avx2=%d avx512f=%d\n", cpu_has_sse2, cpu_has_erms, cpu_has_avx2, cpu_has_avx512f);
+    }
+
+    if (use_tsc)
+    {
+        if (calibrate_tsc(TSC_CALIBRATE_MS) < 0)
+            printf("No invariant TSC, timing with CLOCK_MONOTONIC_RAW instead.\n");
+        else if (!quiet)
+            printf("Timing with the TSC at %.6lf GHz.\n", tsc_hz * 1e-9);
+    }
+
+    if (numa_matrix_mode)
+    {
+        double starttime, endtime;
+        starttime = timestamp();
+        numa_matrix(sel, nr_tests, asize, block_size, backend, nr_loops, nr_repeats, mt, quiet);
+        endtime = timestamp();
+        printf("All tests done in %10.3lf seconds\n\n", endtime - starttime);
+        return 0;
+    }
+
+    if (partition >= 0)
+    {
+        double starttime, endtime;
+        a = make_array(asize + pad, src_node, backend);
+        if (a && nr_arrays > 1)
+            b = make_array(asize + pad, dst_node, backend);
+        if (b && nr_arrays > 2)
+            c = make_array(asize + pad, dst_node, backend);
+        if (!a || (nr_arrays > 1 && !b) || (nr_arrays > 2 && !c))
+            exit(1);
+        if (pad)
+        {
+            a = offset_array(a, src_offset);
+            b = offset_array(b, dst_offset);
+            c = offset_array(c, dst_offset);
+        }
+        struct kernel_args ka = {
+            .a = a,
+            .b = b,
+            .c = c,
+            .asize = asize,
+            .array_bytes = asize * long_size,
+            .block_size = block_size,
+        };
+        if (!quiet)
+        {
+            long *arrays[3] = {a, b, c};
+            report_pages(0, arrays, nr_arrays, asize * long_size, backend);
+        }
+        starttime = timestamp();
+        shared_controller(&ka, sel, nr_tests, partition, nr_procs, cpu_pinno, nr_loops, nr_repeats, mt, quiet);
+        endtime = timestamp();
+        printf("All tests done in %10.3lf seconds\n\n", endtime - starttime);
+        return 0;
     }
 
     /* ------------------------------------------------------ */
     if (!quiet)
     {
         printf("Getting down to business... Doing %d runs per test.\n", nr_loops);
+        if (latency || loaded_pinstr)
+            printf("Measuring load latency with one pointer every %u bytes.\n", loaded_pinstr ? lc.stride : latency);
     }
 
-    volatile char *procmap = mmap(NULL, PROCMAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
-    MYMEMSET(procmap, 0, PROCMAP_SIZE);
+    struct slot *procmap = mmap(NULL, sizeof(struct slot) * (nr_procs + 1), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
 
-    volatile double(**mpresults)[MAX_TESTS] = NULL;
+    /* per worker: row 0 is the average, rows 1..nr_loops the samples,
+     * one column per selected test (per working set for --latency) */
+    volatile double **mpresults = NULL;
     if (nr_loops)
     {
         mpresults = malloc(sizeof(void *) * (nr_procs + 1));
         for (int i = 1; i <= nr_procs; i++)
         {
-            mpresults[i] = (double(*)[MAX_TESTS])mmap(NULL, sizeof(double) * MAX_TESTS * (nr_loops + 1),
-                                                      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+            mpresults[i] = mmap(NULL, sizeof(double) * nr_cols * (nr_loops + 1),
+                                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        }
+    }
+    if (auto_ms)
+        auto_repeats = mmap(NULL, sizeof(int), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (conv.ci || conv.budget)
+    {
+        mpcounts = malloc(sizeof(void *) * (nr_procs + 1));
+        for (int i = 1; i <= nr_procs; i++)
+        {
+            mpcounts[i] = mmap(NULL, sizeof(int) * nr_tests, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                               -1, 0);
+        }
+    }
+    if (sync || fault_mode)
+    {
+        bar = mmap(NULL, sizeof(*bar), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        bar->nr_procs = nr_procs;
+    }
+    if (perf)
+    {
+        mpcounters = malloc(sizeof(void *) * (nr_procs + 1));
+        for (int i = 1; i <= nr_procs; i++)
+        {
+            mpcounters[i] = mmap(NULL, sizeof(double) * nr_tests * NR_PERF_EVENTS,
+                                 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        }
+    }
+    if (nr_loops == 0 && !latency)
+    {
+        rings = malloc(sizeof(void *) * (nr_procs + 1));
+        for (int i = 1; i <= nr_procs; i++)
+        {
+            rings[i] = mmap(NULL, sizeof(struct soak_ring), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        }
+        /* ^C goes to the whole process group; only the controller
+         * handles it, and then stops the workers */
+        signal(SIGINT, SIG_IGN);
+        signal(SIGTERM, SIG_IGN);
+    }
+    if (sync)
+    {
+        mpstamps = malloc(sizeof(void *) * (nr_procs + 1));
+        for (int i = 1; i <= nr_procs; i++)
+        {
+            mpstamps[i] = mmap(NULL, sizeof(double) * 2 * nr_tests * nr_loops,
+                               PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
         }
     }
 
+    /* don't let the workers inherit (and print again) buffered output */
+    fflush(stdout);
     int procno = 0;
     for (int i = 1; i <= nr_procs; i++)
     {
@@ -434,7 +6248,7 @@ int main(int argc, char **argv)
         }
         else if (forkret < 0)
         {
-            MYMEMSET(procmap, -1, PROCMAP_SIZE);
+            abort_workers(procmap, nr_procs);
             perror("error forking workers");
             exit(1);
             return 1;
@@ -442,132 +6256,171 @@ int main(int argc, char **argv)
     }
     if (procno <= 0)
     { // Controller process
-        struct timeval starttime, endtime;
+        double starttime, endtime;
 
-        printf("Ensure all process can respond simultaneously after 1s.\n");
-        usleep(1000000);
-        gettimeofday(&starttime, NULL);
+        printf("Checking that all workers respond simultaneously.\n");
         for (int i = 1; i <= nr_procs; i++)
-            procmap[i] = 1;
+            state_wait(&procmap[i], ST_FORKED);
+        double since = timestamp();
+        starttime = timestamp();
         for (int i = 1; i <= nr_procs; i++)
-            while (procmap[i] == 1)
-                ;
-        gettimeofday(&endtime, NULL);
-        printf("Syncing all workers cost %4.3lf seconds.\nIf that's too long, the result should be considered unreliable.\n", gettimedelta(starttime, endtime));
+            state_set(&procmap[i], ST_PING);
+        for (int i = 1; i <= nr_procs; i++)
+            state_wait(&procmap[i], ST_PING);
+        endtime = timestamp();
+        printf("Syncing all workers cost %4.3lf seconds.\n", endtime - starttime);
+        print_release_skew(procmap, nr_procs, since);
+        printf("If that's too long, the result should be considered unreliable.\n");
 
-        printf("Pre-allocate memory after 1s.\n");
-        usleep(1000000);
-        gettimeofday(&starttime, NULL);
+        starttime = timestamp();
         for (int i = 1; i <= nr_procs; i++)
-            procmap[i] = 3;
+            state_set(&procmap[i], ST_ALLOC);
         for (int i = 1; i <= nr_procs; i++)
         {
-            while (procmap[i] == 3)
-                ;
-            if (procmap[i] < 0)
+            if (state_wait(&procmap[i], ST_ALLOC) != ST_READY)
             {
-                MYMEMSET(procmap, -1, PROCMAP_SIZE);
+                abort_workers(procmap, nr_procs);
                 printf("Worker %d failed to allocate memory. Exiting...\n", i);
                 exit(1);
             }
         }
-        gettimeofday(&endtime, NULL);
-        printf("Pre-allocating memory cost %4.3lf seconds.\n", gettimedelta(starttime, endtime));
+        endtime = timestamp();
+        printf("Pre-allocating memory cost %4.3lf seconds.\n", endtime - starttime);
+        if (!quiet && !fault_mode)
+        {
+            for (int i = 1; i <= nr_procs; i++)
+                printf("worker %d: allocated and filled %d arrays in %.3lf seconds, %.3lf GiB/s\n", i, nr_arrays,
+                       procmap[i].alloc_time, nr_arrays * asize * long_size / procmap[i].alloc_time / (1 << 30));
+        }
+        if (auto_ms)
+        {
+            nr_repeats = *auto_repeats;
+            printf("Calibrated %d repeats per sample for samples of %.1lf ms.\n", nr_repeats, auto_ms);
+        }
 
-        printf("Run tests after 2s.\n");
-        usleep(2000000);
-        gettimeofday(&starttime, NULL);
+        if (scaling)
+        {
+            starttime = timestamp();
+            scaling_controller(procmap, mpresults, nr_procs, cpu_pinno, sel, nr_tests, nr_repeats, mt, quiet);
+            endtime = timestamp();
+            printf("All tests done in %10.3lf seconds\n\n", endtime - starttime);
+            return 0;
+        }
+        if (loaded_pinstr)
+        {
+            starttime = timestamp();
+            loaded_controller(procmap, mpresults, &lc, nr_procs);
+            endtime = timestamp();
+            printf("All tests done in %10.3lf seconds\n\n", endtime - starttime);
+            return 0;
+        }
+        memset(&imc, 0, sizeof(imc));
+        if (perf && imc_open(&imc) == 0 && !quiet)
+            printf("perf: no memory controller counters (needs uncore_imc and perf_event_paranoid <= 0)\n");
+        perf_start(imc.fds, imc.nr);
+        since = timestamp();
+        starttime = timestamp();
         for (int i = 1; i <= nr_procs; i++)
-            procmap[i] = 5;
+            state_set(&procmap[i], ST_RUN);
         if (!nr_loops)
+        {
+            if (rings)
+                soak_controller(procmap, rings, nr_procs, &kernels[sel[0]], nr_repeats, mt, interval);
             return 0;
+        }
         for (int i = 1; i <= nr_procs; i++)
-            while (procmap[i] == 5)
-                ;
-        gettimeofday(&endtime, NULL);
-        double total_run_time = gettimedelta(starttime, endtime);
+            state_wait(&procmap[i], ST_RUN);
+        endtime = timestamp();
+        double total_run_time = endtime - starttime;
+        if (!quiet)
+            print_release_skew(procmap, nr_procs, since);
 
-        double(*speedsum)[MAX_TESTS] = malloc(sizeof(double) * nr_procs * MAX_TESTS);
-        double(*speedsqsum)[MAX_TESTS] = malloc(sizeof(double) * nr_procs * MAX_TESTS);
-        double *idletime = malloc(sizeof(double) * nr_procs);
-        for (int i = 1; i <= nr_procs; i++)
+        if (fault_mode)
         {
-            double worker_run_time = 0;
-            printf("Worker #%d\n", i);
-            for (int testno = 0; testno < MAX_TESTS; testno++)
-            {
-                for (int j = 0; j <= nr_loops; j++)
-                {
-                    printf("%8.3lf\t", mpresults[i][j][testno]);
-                }
-                worker_run_time += mpresults[i][0][testno] * nr_loops;
-                printf("\n");
-            }
-            for (int testno = 0; testno < MAX_TESTS; testno++)
-            {
-                speedsum[i - 1][testno] = 0;
-                speedsqsum[i - 1][testno] = 0;
-                for (int j = 0; j <= nr_loops; j++)
-                {
-                    double speed = mt * nr_repeats / mpresults[i][j][testno];
-                    printf("%8.3lf\t", speed);
-                    if (j)
-                    {
-                        speedsum[i - 1][testno] += speed;
-                        speedsqsum[i - 1][testno] += speed * speed;
-                    }
-                }
-                printf("\n");
-            }
-            idletime[i - 1] = total_run_time - worker_run_time;
-            printf("Worker idle time: %8.3lf\n", idletime[i - 1]);
+            fault_report(mpresults, nr_procs, asize * long_size, nr_loops);
+            printf("All tests done in %10.3lf seconds\n\n", total_run_time);
+            return 0;
+        }
+        if (latency)
+        {
+            latency_report(mpresults, nr_procs, sizes, nr_sizes, nr_loops, histogram);
+            printf("All tests done in %10.3lf seconds\n\n", total_run_time);
+            return 0;
+        }
+        if (nr_offsets)
+        {
+            offset_report(mpresults, nr_procs, offsets, nr_offsets, sel, nr_tests, nr_repeats, mt);
+            printf("All tests done in %10.3lf seconds\n\n", total_run_time);
+            return 0;
+        }
+        if (nr_dists)
+        {
+            prefetch_report(mpresults, nr_procs, dists, nr_dists, sel, nr_tests, nr_repeats, mt);
+            printf("All tests done in %10.3lf seconds\n\n", total_run_time);
+            return 0;
+        }
+        if (nr_block_sizes)
+        {
+            block_sweep_report(mpresults, nr_procs, block_sizes, nr_block_sizes, nr_repeats, mt);
+            printf("All tests done in %10.3lf seconds\n\n", total_run_time);
+            return 0;
+        }
+        if (sweep_str)
+        {
+            sweep_report(mpresults, nr_procs, sel, nr_tests, sizes, nr_sizes, nr_repeats);
+            printf("All tests done in %10.3lf seconds\n\n", total_run_time);
+            return 0;
         }
 
+        bandwidth_report(mpresults, mpcounts, nr_procs, sel, nr_tests, nr_loops, nr_repeats, mt, total_run_time,
+                         histogram);
+        if (sync)
+            sync_report(mpstamps, nr_procs, sel, nr_tests, nr_loops, nr_repeats, mt);
+        if (perf)
+            perf_report(mpcounters, mpresults, nr_procs, sel, nr_tests, nr_loops, nr_repeats, mt);
+        if (imc.nr)
         {
-            printf("\nSpeed, std-dev and idletime:\n");
-            for (int testno = 0; testno < MAX_TESTS; testno++)
-            {
-                for (int i = 0; i < nr_procs; i++)
-                {
-                    printf(" %7.2lf", speedsum[i][testno] / nr_loops);
-                }
-                printf(" |");
-                for (int i = 0; i < nr_procs; i++)
-                {
-                    double std_dev = nr_procs > 1 ? sqrt((speedsqsum[i][testno] - speedsum[i][testno] * speedsum[i][testno] / nr_loops) / (nr_procs - 1)) : 0;
-                    printf(" %7.2lf", std_dev);
-                }
-                printf("\n");
-            }
-            /*
-            printf("debug:\n");
-            for (int testno = 0; testno < MAX_TESTS; testno++)
-            {
-                for (int i = 0; i < nr_procs; i++)
-                {
-                    printf("  speedsum[%d][%d]=%7.2lf\n", i, testno, speedsum[i][testno]);
-                    printf("  speedssq[%d][%d]=%7.2lf\n", i, testno, speedsqsum[i][testno]);
-                }
-            }
-            */
-            printf("\nTotal speed:\n");
-            for (int testno = 0; testno < MAX_TESTS; testno++)
+            double read_mib, write_mib;
+            imc_stop(&imc, &read_mib, &write_mib);
+            printf("Memory controllers, whole system over the run: read %.2lf MiB/s, write %.2lf MiB/s\n",
+                   read_mib / total_run_time, write_mib / total_run_time);
+        }
+        if (json_path || csv_path || baseline_path)
+        {
+            struct run_config rc = {
+                .array_bytes = asize * long_size,
+                .block_size = block_size,
+                .nr_repeats = nr_repeats,
+                .nr_loops = nr_loops,
+                .nr_procs = nr_procs,
+                .cpus = cpu_pinno,
+                .sel = sel,
+                .nr_tests = nr_tests,
+                .backend = backend,
+                .src_node = src_node,
+                .dst_node = dst_node,
+                .cold = cold,
+                .sync = sync,
+                .run_time = total_run_time,
+                .mpresults = mpresults,
+                .mpcounts = mpcounts,
+                .mt = mt,
+            };
+            struct host_info h;
+            host_info(&h);
+            if (json_path)
+                write_json(json_path, &rc, &h);
+            if (csv_path)
+                write_csv(csv_path, &rc, &h);
+            if (baseline_path)
             {
-                double sum = 0, sumsq = 0;
-                for (int i = 0; i < nr_procs; i++)
+                int regressed = check_baseline(baseline_path, &rc, threshold);
+                if (regressed)
                 {
-                    sum += speedsum[i][testno];
-                    sumsq += speedsqsum[i][testno];
+                    printf("All tests done in %10.3lf seconds\n\n", total_run_time);
+                    return regressed < 0 ? 1 : EXIT_REGRESSED;
                 }
-                double std_dev = nr_procs > 1 ? sqrt((sumsq - sum * sum / (nr_loops * nr_procs)) / (nr_procs - 1)) : 0;
-                printf("%7.2lf %7.2lf   ", sum, std_dev);
-            }
-            printf("\n");
-            for (int i = 0; i < nr_procs; i++)
-            {
-                printf(" %7.2lf", idletime[i]);
             }
-            printf("\n");
         }
         printf("All tests done in %10.3lf seconds\n\n", total_run_time);
     }
@@ -577,55 +6430,139 @@ int main(int argc, char **argv)
         CPU_ZERO(&cur_proc_cpu_set);
         CPU_SET(cpu_pinno[procno], &cur_proc_cpu_set);
         sched_setaffinity(0, sizeof(cur_proc_cpu_set), &cur_proc_cpu_set);
-        while (procmap[procno] == 0)
-            ;
-        if (procmap[procno] < 0)
+        struct slot *slot = &procmap[procno];
+        state_set(slot, ST_PINNED);
+        worker_wait(slot, ST_PINNED);
+        state_set(slot, ST_PONG);
+        worker_wait(slot, ST_PONG);
+        if (fault_mode)
+        {
+            state_set(slot, ST_READY);
+            worker_wait(slot, ST_READY);
+            fault_worker(procno, asize * long_size, nr_loops, quiet, bar, mpresults[procno]);
+            state_set(slot, ST_DONE);
+            exit(0);
+        }
+        double alloc_start = timestamp();
+        a = make_array(asize + pad, src_node, backend);
+        if (a && nr_arrays > 1)
+            b = make_array(asize + pad, dst_node, backend);
+        if (b && nr_arrays > 2)
+            c = make_array(asize + pad, dst_node, backend);
+        if (!a || (nr_arrays > 1 && !b) || (nr_arrays > 2 && !c))
+        {
+            state_set(slot, ST_ABORT);
             exit(1);
-        //We expect procmap[procno]==1 here.
-        procmap[procno] = 2;
-        while (procmap[procno] == 2)
-            ;
-        if (procmap[procno] < 0)
+        }
+        if (needs_index && !(idx = (unsigned int *)make_array((asize + 1) / 2, src_node, backend)))
+        {
+            state_set(slot, ST_ABORT);
             exit(1);
-        a = make_array(asize);
-        b = make_array(asize);
-        procmap[procno] = 4;
-        while (procmap[procno] == 4)
-            ;
-        if (procmap[procno] < 0)
+        }
+        if (needs_index)
+            build_index(idx, asize, procno);
+        slot->alloc_time = timestamp() - alloc_start;
+        long *bases[3] = {a, b, c};
+        if (pad)
+        {
+            a = offset_array(a, src_offset);
+            b = offset_array(b, dst_offset);
+            c = offset_array(c, dst_offset);
+        }
+        if (cold == COLD_EVICT && !(evict = (char *)make_array(evict_size() / sizeof(long), -1, ALLOC_MALLOC)))
+        {
+            state_set(slot, ST_ABORT);
             exit(1);
+        }
+        if (!quiet)
+        {
+            long *arrays[3] = {a, b, c};
+            report_pages(procno, arrays, nr_arrays, asize * long_size, backend);
+            fflush(stdout);
+        }
+        struct kernel_args ka = {
+            .a = a,
+            .b = b,
+            .c = c,
+            .asize = asize,
+            .array_bytes = asize * long_size,
+            .block_size = block_size,
+            .cold = cold,
+            .evict = evict,
+            .evict_bytes = evict ? evict_size() : 0,
+            .idx = idx,
+        };
+        /* the others are allocated and idle by the time they read it */
+        if (auto_ms && procno == 1)
+            *auto_repeats = calibrate_repeats(&ka, sel, nr_tests, auto_ms * 1e-3);
+        state_set(slot, ST_READY);
+        worker_wait(slot, ST_READY);
+        if (auto_ms)
+            nr_repeats = *auto_repeats;
+
+        if (loaded_pinstr)
+            loaded_worker(procno, slot, &lc, a, b, c, asize, nr_loops, nr_repeats, quiet, mpresults[procno]);
+        if (latency)
+        {
+            latency_worker(procno, a, sizes, nr_sizes, latency, nr_loops, nr_repeats, quiet, showavg,
+                           nr_loops ? mpresults[procno] : NULL);
+            state_set(slot, ST_DONE);
+            exit(0);
+        }
 
-        double(*results)[MAX_TESTS] = NULL;
+        volatile double *results = NULL;
         if (nr_loops)
-            results = (double(*))mpresults[procno];
-        /* run all tests requested, the proper number of times */
-        for (testno = 0; testno < MAX_TESTS; testno++)
+            results = mpresults[procno];
+        if (nr_offsets)
         {
-            te_sum = 0;
-            if (tests[testno])
-            {
-                for (i = 0; nr_loops == 0 || i < nr_loops; i++)
-                {
-                    te = worker(asize, a, b, testno, block_size, nr_repeats);
-                    te_sum += te;
-                    if (!quiet)
-                    {
-                        printf("worker %d\t%d\t", procno, i);
-                        printout(te, mt * nr_repeats, testno);
-                    }
-                    //putchar('.');
-                    if (nr_loops)
-                        results[i + 1][testno] = te;
-                }
-                if (showavg && !quiet)
-                {
-                    printf("worker %d\tAVG\t", procno);
-                    printout(te_sum / nr_loops, mt * nr_repeats, testno);
-                }
-                results[0][testno] = te_sum / nr_loops;
-            }
+            offset_worker(procno, &ka, bases, offsets, nr_offsets, sel, nr_tests, nr_loops, nr_repeats, mt, quiet,
+                          results);
+            state_set(slot, ST_DONE);
+            exit(0);
+        }
+        if (nr_dists)
+        {
+            prefetch_worker(procno, &ka, dists, nr_dists, sel, nr_tests, nr_loops, nr_repeats, mt, quiet, results);
+            state_set(slot, ST_DONE);
+            exit(0);
+        }
+        if (nr_block_sizes)
+        {
+            block_sweep_worker(procno, &ka, block_sizes, nr_block_sizes, nr_loops, nr_repeats, mt, quiet, results);
+            state_set(slot, ST_DONE);
+            exit(0);
+        }
+        if (sweep_str)
+        {
+            sweep_worker(procno, &ka, sel, nr_tests, sizes, nr_sizes, nr_loops, nr_repeats, quiet, results);
+            state_set(slot, ST_DONE);
+            exit(0);
+        }
+        struct perf_counters pc;
+        if (perf)
+        {
+            pc.counts = mpcounters[procno];
+            if (perf_open_worker(&pc, procno, nr_tests) == 0)
+                perf = 0;
+        }
+        if (rings)
+        {
+            soak_worker(slot, &ka, &kernels[sel[0]], nr_repeats, rings[procno]);
+            state_set(slot, ST_DONE);
+            exit(0);
+        }
+        if (scaling)
+            scaling_worker(procno, slot, &ka, sel, nr_tests, nr_loops, nr_repeats, mt, results);
+        if (sync)
+            sync_worker(procno, &ka, sel, nr_tests, nr_loops, nr_repeats, mt, quiet, bar, results, mpstamps[procno],
+                        perf ? &pc : NULL);
+        else
+        {
+            conv.counts = mpcounts ? mpcounts[procno] : NULL;
+            bandwidth_worker(procno, &ka, sel, nr_tests, nr_loops, nr_repeats, mt, quiet, showavg, results,
+                             perf ? &pc : NULL, mpcounts ? &conv : NULL);
         }
-        procmap[procno] = 6;
+        state_set(slot, ST_DONE);
         exit(0);
     }
 
@@ -1,6 +1,6 @@
 Summary: Memory bandwidth benchmark
 Name: mbw
-Version: 1.4
+Version: 1.5
 Release: 1%{?dist}
 License: LGPLv2.1
 Buildroot: %{_tmppath}/%{name}-buildroot
@@ -9,7 +9,12 @@ Source: %{name}.tar.gz
 Packager: andras.horvath@gmail.com
 
 %description
-Test memory copy bandwidth (single thread). Switch off swap or make sure array size does not exceed available free RAM.
+Test memory bandwidth and latency with one or more pinned worker processes:
+copy, STREAM and SIMD kernels, working set, block size, offset and prefetch
+sweeps, worker count scaling (--scaling, which replaces mbw-gen), loaded
+latency, NUMA placement, page faults, small copies, cross-process copies,
+cache line transfers and producer/consumer rings. Switch off swap or make
+sure the arrays do not exceed the available free RAM.
 
 %prep
 %setup -n %{name}
@@ -33,6 +38,10 @@ rm -rf %{buildroot}
 %attr(644,-,-) %{_mandir}/man1/mbw.1.gz
 
 %changelog
+* Fri Oct 16 2026 agent <agent@local> 1.5-1
+- Multiple pinned workers with a futex handshake, and many more tests and modes; see mbw(1)
+- Drop mbw-gen, superseded by --scaling
+
 * Fri May 04 2018 Andras Horvath <andras.horvath@gmail.com> 1.4-2
 - Explicitly specify licence version
 